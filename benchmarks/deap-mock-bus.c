@@ -0,0 +1,567 @@
+/* deap-mock-bus.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Mock org.gnome.Shell and org.freedesktop.login1 for benchmarks/mockbus.py
+ *
+ * Implements what deap uses of both, from the same bundled interface XML:
+ *
+ *  - org.gnome.Shell (ShellVersion) and org.gnome.Shell.Extensions
+ *    (ListExtensions, LaunchExtensionPrefs, ExtensionStateChanged) with
+ *    --extensions records, on the session bus;
+ *  - org.freedesktop.login1.Manager (ListSessions, LockSession,
+ *    LockSessions, SessionNew, SessionRemoved) with --sessions sessions, plus
+ *    Properties of org.freedesktop.login1.Session for every session
+ *    object, on the system bus.
+ *
+ * Method replies are delayed by --latency-ms. With --churn-ms, one
+ * session is replaced and one extension toggled every interval.
+ * "READY" is printed once both names are owned. The harness points both
+ * buses at the same private dbus-daemon.
+ */
+
+#include "deap-dbus-login1.h"
+#include "deap-dbus-shell.h"
+#include "deap-dbus-shell-extensions.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SESSION_PATH_PREFIX   "/org/freedesktop/login1/session"
+
+#define EXTENSION_STATE_ENABLED   1.0
+#define EXTENSION_STATE_DISABLED  2.0
+
+typedef struct
+{
+  DeapDBusShell             *shell;
+  DeapDBusShellExtensions   *extensions;
+  DeapDBusLogin1Manager     *login1;
+
+  /* uuid -> a{sv}, the state toggled by churn */
+  GHashTable                *extension_info;
+  GPtrArray                 *extension_uuids;
+
+  /* session ID -> user ID; IDs are decimal and never reused */
+  GHashTable                *sessions;
+  guint                      next_session_id;
+
+  guint                      n_names_owned;
+} MockBus;
+
+static gint n_extensions = 100;
+static gint n_sessions = 100;
+static gint latency_msec = 0;
+static gint churn_msec = 0;
+
+static GOptionEntry entries[] = {
+  { "extensions", 0, 0, G_OPTION_ARG_INT, &n_extensions, "Number of extensions", "N" },
+  { "sessions", 0, 0, G_OPTION_ARG_INT, &n_sessions, "Number of sessions", "N" },
+  { "latency-ms", 0, 0, G_OPTION_ARG_INT, &latency_msec, "Delay of every method reply", "MSEC" },
+  { "churn-ms", 0, 0, G_OPTION_ARG_INT, &churn_msec, "Replace a session and toggle an extension every MSEC", "MSEC" },
+  { NULL }
+};
+
+static const gchar session_xml[] =
+  "<node>"
+  "  <interface name='org.freedesktop.login1.Session'>"
+  "    <property name='Id' type='s' access='read'/>"
+  "    <property name='User' type='(uo)' access='read'/>"
+  "    <property name='Name' type='s' access='read'/>"
+  "    <property name='Seat' type='(so)' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+static GDBusNodeInfo *session_node_info = NULL;
+
+
+/* --- Replies --- */
+typedef struct
+{
+  GDBusMethodInvocation *invocation;
+  GVariant              *reply;
+} DelayedReply;
+
+static gboolean
+delayed_reply_cb (gpointer user_data)
+{
+  DelayedReply *delayed = user_data;
+
+  g_dbus_method_invocation_return_value (delayed->invocation, delayed->reply);
+  g_free (delayed);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Takes the floating @reply, which is the whole out tuple */
+static void
+return_value (GDBusMethodInvocation *invocation,
+              GVariant              *reply)
+{
+  DelayedReply *delayed;
+
+  if (latency_msec <= 0) {
+    g_dbus_method_invocation_return_value (invocation, reply);
+    return;
+  }
+
+  delayed = g_new0 (DelayedReply, 1);
+  delayed->invocation = invocation;
+  delayed->reply = reply;
+
+  g_timeout_add (latency_msec, delayed_reply_cb, delayed);
+}
+/* --- End of Replies --- */
+
+
+/* --- org.gnome.Shell.Extensions --- */
+static GVariant *
+new_extension_info (const gchar *uuid,
+                    guint        n,
+                    gdouble      state)
+{
+  g_autofree gchar *name = g_strdup_printf ("Mock Extension %u", n);
+  g_autofree gchar *url = g_strdup_printf ("https://extensions.example.org/%u", n);
+  GVariantDict dict;
+
+  g_variant_dict_init (&dict, NULL);
+  g_variant_dict_insert (&dict, "uuid", "s", uuid);
+  g_variant_dict_insert (&dict, "name", "s", name);
+  g_variant_dict_insert (&dict, "description", "s", "An extension served by deap-mock-bus");
+  g_variant_dict_insert (&dict, "url", "s", url);
+  g_variant_dict_insert (&dict, "type", "d", 2.0);
+  g_variant_dict_insert (&dict, "state", "d", state);
+
+  return g_variant_ref_sink (g_variant_dict_end (&dict));
+}
+
+static void
+populate_extensions (MockBus *mock)
+{
+  guint i;
+
+  mock->extension_info = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                g_free, (GDestroyNotify) g_variant_unref);
+  mock->extension_uuids = g_ptr_array_new ();
+
+  for (i = 0; i < (guint) n_extensions; i++) {
+    gchar *uuid = g_strdup_printf ("mock-%u@deap.example.org", i);
+
+    g_hash_table_insert (mock->extension_info, uuid,
+                         new_extension_info (uuid, i, EXTENSION_STATE_ENABLED));
+    g_ptr_array_add (mock->extension_uuids, uuid);
+  }
+}
+
+static gboolean
+handle_list_extensions (DeapDBusShellExtensions *skeleton,
+                        GDBusMethodInvocation   *invocation,
+                        gpointer                 user_data)
+{
+  MockBus *mock = user_data;
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  for (i = 0; i < mock->extension_uuids->len; i++) {
+    const gchar *uuid = g_ptr_array_index (mock->extension_uuids, i);
+
+    g_variant_builder_add (&builder, "{s@a{sv}}", uuid,
+                           g_hash_table_lookup (mock->extension_info, uuid));
+  }
+
+  return_value (invocation, g_variant_new ("(a{sa{sv}})", &builder));
+
+  return TRUE;
+}
+
+static gboolean
+handle_launch_extension_prefs (DeapDBusShellExtensions *skeleton,
+                               GDBusMethodInvocation   *invocation,
+                               const gchar             *uuid,
+                               gpointer                 user_data)
+{
+  return_value (invocation, g_variant_new ("()"));
+
+  return TRUE;
+}
+
+static void
+toggle_extension (MockBus *mock)
+{
+  const gchar *uuid;
+  GVariant *info;
+  gdouble state = 0;
+  guint n;
+
+  if (mock->extension_uuids->len == 0)
+    return;
+
+  n = g_random_int_range (0, mock->extension_uuids->len);
+  uuid = g_ptr_array_index (mock->extension_uuids, n);
+
+  g_variant_lookup (g_hash_table_lookup (mock->extension_info, uuid), "state", "d", &state);
+  state = state == EXTENSION_STATE_ENABLED ? EXTENSION_STATE_DISABLED : EXTENSION_STATE_ENABLED;
+
+  info = new_extension_info (uuid, n, state);
+  g_hash_table_insert (mock->extension_info, g_strdup (uuid), info);
+
+  deap_dbus_shell_extensions_emit_extension_state_changed (mock->extensions, uuid, info);
+}
+/* --- End of org.gnome.Shell.Extensions --- */
+
+
+/* --- org.freedesktop.login1 --- */
+static guint32
+session_user_id (guint session_id)
+{
+  return 1000 + session_id % 64;
+}
+
+static gchar *
+session_object_path (const gchar *session_id)
+{
+  return g_strconcat (SESSION_PATH_PREFIX "/", session_id, NULL);
+}
+
+static const gchar *
+add_session (MockBus *mock)
+{
+  guint id = mock->next_session_id++;
+  gchar *session_id = g_strdup_printf ("%u", id);
+
+  g_hash_table_insert (mock->sessions, session_id, GUINT_TO_POINTER (session_user_id (id)));
+
+  return session_id;
+}
+
+static gboolean
+handle_list_sessions (DeapDBusLogin1Manager *skeleton,
+                      GDBusMethodInvocation *invocation,
+                      gpointer               user_data)
+{
+  MockBus *mock = user_data;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(susso)"));
+
+  g_hash_table_iter_init (&iter, mock->sessions);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_autofree gchar *user_name = g_strdup_printf ("user%u", GPOINTER_TO_UINT (value));
+    g_autofree gchar *path = session_object_path (key);
+
+    g_variant_builder_add (&builder, "(susso)",
+                           key, GPOINTER_TO_UINT (value), user_name, "seat0", path);
+  }
+
+  return_value (invocation, g_variant_new ("(a(susso))", &builder));
+
+  return TRUE;
+}
+
+static gboolean
+handle_lock_session (DeapDBusLogin1Manager *skeleton,
+                     GDBusMethodInvocation *invocation,
+                     const gchar           *session_id,
+                     gpointer               user_data)
+{
+  MockBus *mock = user_data;
+
+  if (!g_hash_table_contains (mock->sessions, session_id)) {
+    g_dbus_method_invocation_return_dbus_error (invocation,
+                                                "org.freedesktop.login1.NoSuchSession",
+                                                "No session by that ID");
+    return TRUE;
+  }
+
+  return_value (invocation, g_variant_new ("()"));
+
+  return TRUE;
+}
+
+static gboolean
+handle_lock_sessions (DeapDBusLogin1Manager *skeleton,
+                      GDBusMethodInvocation *invocation,
+                      gpointer               user_data)
+{
+  return_value (invocation, g_variant_new ("()"));
+
+  return TRUE;
+}
+
+static GVariant *
+session_get_property (GDBusConnection  *connection,
+                      const gchar      *sender,
+                      const gchar      *object_path,
+                      const gchar      *interface_name,
+                      const gchar      *property_name,
+                      GError          **error,
+                      gpointer          user_data)
+{
+  MockBus *mock = user_data;
+  const gchar *session_id;
+  gpointer user_id;
+  g_autofree gchar *user_path = NULL;
+
+  session_id = object_path + strlen (SESSION_PATH_PREFIX "/");
+
+  if (!g_hash_table_lookup_extended (mock->sessions, session_id, NULL, &user_id)) {
+    g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT, "No session %s", session_id);
+    return NULL;
+  }
+
+  if (g_str_equal (property_name, "Id"))
+    return g_variant_new_string (session_id);
+
+  if (g_str_equal (property_name, "Name"))
+    return g_variant_new_take_string (g_strdup_printf ("user%u", GPOINTER_TO_UINT (user_id)));
+
+  if (g_str_equal (property_name, "Seat"))
+    return g_variant_new ("(so)", "seat0", "/org/freedesktop/login1/seat/seat0");
+
+  user_path = g_strdup_printf ("/org/freedesktop/login1/user/_%u", GPOINTER_TO_UINT (user_id));
+  return g_variant_new ("(uo)", GPOINTER_TO_UINT (user_id), user_path);
+}
+
+static const GDBusInterfaceVTable session_vtable = {
+  NULL,
+  session_get_property,
+  NULL,
+};
+
+/* Session objects are not enumerated: 10k nodes would make Introspect the benchmark */
+static gchar **
+session_subtree_enumerate (GDBusConnection *connection,
+                           const gchar     *sender,
+                           const gchar     *object_path,
+                           gpointer         user_data)
+{
+  return g_new0 (gchar *, 1);
+}
+
+static GDBusInterfaceInfo **
+session_subtree_introspect (GDBusConnection *connection,
+                            const gchar     *sender,
+                            const gchar     *object_path,
+                            const gchar     *node,
+                            gpointer         user_data)
+{
+  GDBusInterfaceInfo **infos;
+
+  if (node == NULL)
+    return NULL;
+
+  infos = g_new0 (GDBusInterfaceInfo *, 2);
+  infos[0] = g_dbus_interface_info_ref (session_node_info->interfaces[0]);
+
+  return infos;
+}
+
+static const GDBusInterfaceVTable *
+session_subtree_dispatch (GDBusConnection *connection,
+                          const gchar     *sender,
+                          const gchar     *object_path,
+                          const gchar     *interface_name,
+                          const gchar     *node,
+                          gpointer        *out_user_data,
+                          gpointer         user_data)
+{
+  *out_user_data = user_data;
+
+  return &session_vtable;
+}
+
+static const GDBusSubtreeVTable session_subtree_vtable = {
+  session_subtree_enumerate,
+  session_subtree_introspect,
+  session_subtree_dispatch,
+};
+
+static void
+replace_session (MockBus *mock)
+{
+  GHashTableIter iter;
+  gpointer key;
+  g_autofree gchar *path = NULL;
+  const gchar *session_id;
+
+  g_hash_table_iter_init (&iter, mock->sessions);
+  if (g_hash_table_iter_next (&iter, &key, NULL)) {
+    g_autofree gchar *removed_id = g_strdup (key);
+
+    g_hash_table_iter_remove (&iter);
+
+    path = session_object_path (removed_id);
+    deap_dbus_login1_manager_emit_session_removed (mock->login1, removed_id, path);
+    g_clear_pointer (&path, g_free);
+  }
+
+  session_id = add_session (mock);
+
+  path = session_object_path (session_id);
+  deap_dbus_login1_manager_emit_session_new (mock->login1, session_id, path);
+}
+/* --- End of org.freedesktop.login1 --- */
+
+
+/* --- Bus names --- */
+static gboolean
+churn_cb (gpointer user_data)
+{
+  MockBus *mock = user_data;
+
+  replace_session (mock);
+  toggle_extension (mock);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+name_acquired_cb (GDBusConnection *connection,
+                  const gchar     *name,
+                  gpointer         user_data)
+{
+  MockBus *mock = user_data;
+
+  if (++mock->n_names_owned < 2)
+    return;
+
+  if (churn_msec > 0)
+    g_timeout_add (churn_msec, churn_cb, mock);
+
+  printf ("READY\n");
+  fflush (stdout);
+}
+
+static void
+name_lost_cb (GDBusConnection *connection,
+              const gchar     *name,
+              gpointer         user_data)
+{
+  g_printerr ("deap-mock-bus: could not own %s\n", name);
+  exit (EXIT_FAILURE);
+}
+
+static void
+export_or_die (GDBusInterfaceSkeleton *skeleton,
+               GDBusConnection        *connection,
+               const gchar            *object_path)
+{
+  g_autoptr(GError) error = NULL;
+
+  if (!g_dbus_interface_skeleton_export (skeleton, connection, object_path, &error)) {
+    g_printerr ("deap-mock-bus: %s\n", error->message);
+    exit (EXIT_FAILURE);
+  }
+}
+
+static void
+shell_bus_acquired_cb (GDBusConnection *connection,
+                       const gchar     *name,
+                       gpointer         user_data)
+{
+  MockBus *mock = user_data;
+
+  export_or_die (G_DBUS_INTERFACE_SKELETON (mock->shell), connection, "/org/gnome/Shell");
+  export_or_die (G_DBUS_INTERFACE_SKELETON (mock->extensions), connection, "/org/gnome/Shell");
+}
+
+static void
+login1_bus_acquired_cb (GDBusConnection *connection,
+                        const gchar     *name,
+                        gpointer         user_data)
+{
+  MockBus *mock = user_data;
+  g_autoptr(GError) error = NULL;
+
+  export_or_die (G_DBUS_INTERFACE_SKELETON (mock->login1), connection, "/org/freedesktop/login1");
+
+  if (!g_dbus_connection_register_subtree (connection,
+                                           SESSION_PATH_PREFIX,
+                                           &session_subtree_vtable,
+                                           G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES,
+                                           mock,
+                                           NULL,
+                                           &error)) {
+    g_printerr ("deap-mock-bus: %s\n", error->message);
+    exit (EXIT_FAILURE);
+  }
+}
+/* --- End of Bus names --- */
+
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = NULL;
+  g_autoptr(GMainLoop) loop = NULL;
+  g_autoptr(GError) error = NULL;
+  MockBus mock = { NULL, };
+  gint i;
+
+  context = g_option_context_new ("- mock D-Bus services for deap benchmarks");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("deap-mock-bus: %s\n", error->message);
+    return EXIT_FAILURE;
+  }
+
+  session_node_info = g_dbus_node_info_new_for_xml (session_xml, NULL);
+
+  populate_extensions (&mock);
+
+  mock.sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  mock.next_session_id = 1;
+  for (i = 0; i < n_sessions; i++)
+    add_session (&mock);
+
+  mock.shell = deap_dbus_shell_skeleton_new ();
+  deap_dbus_shell_set_shell_version (mock.shell, "3.34.1");
+
+  mock.extensions = deap_dbus_shell_extensions_skeleton_new ();
+  g_signal_connect (mock.extensions, "handle-list-extensions",
+                    G_CALLBACK (handle_list_extensions), &mock);
+  g_signal_connect (mock.extensions, "handle-launch-extension-prefs",
+                    G_CALLBACK (handle_launch_extension_prefs), &mock);
+
+  mock.login1 = deap_dbus_login1_manager_skeleton_new ();
+  g_signal_connect (mock.login1, "handle-list-sessions",
+                    G_CALLBACK (handle_list_sessions), &mock);
+  g_signal_connect (mock.login1, "handle-lock-session",
+                    G_CALLBACK (handle_lock_session), &mock);
+  g_signal_connect (mock.login1, "handle-lock-sessions",
+                    G_CALLBACK (handle_lock_sessions), &mock);
+
+  g_bus_own_name (G_BUS_TYPE_SESSION, "org.gnome.Shell", G_BUS_NAME_OWNER_FLAGS_NONE,
+                  shell_bus_acquired_cb, name_acquired_cb, name_lost_cb, &mock, NULL);
+  g_bus_own_name (G_BUS_TYPE_SYSTEM, "org.freedesktop.login1", G_BUS_NAME_OWNER_FLAGS_NONE,
+                  login1_bus_acquired_cb, name_acquired_cb, name_lost_cb, &mock, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+#
+# Scalability benchmark against mock org.gnome.Shell and
+# org.freedesktop.login1 services.
+#
+# Starts a private dbus-daemon, points both the session and the system
+# bus at it, serves N extensions and M sessions from deap-mock-bus and
+# launches deap against them with DEAP_PROFILE_STARTUP set. For every
+# run it collects
+#
+#  - time-to-populated of the gnome-shell and freedesktop-login1 pages,
+#    from the DEAP-MARK lines (see startup.py),
+#  - peak RSS, and
+#  - main-loop stall time, from the mainloop.stall histogram
+#
+# of the --dump-metrics JSON, and reports them as JSON on stdout. Runs
+# are cold starts with a private XDG_CACHE_HOME, see run_once().
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+from startup import SKIP, run_once, summarize
+
+PAGES = ('page:gnome-shell', 'page:freedesktop-login1')
+
+
+class MockBus:
+    def __init__(self, mock, extensions, sessions, latency_ms, churn_ms):
+        self.daemon = subprocess.Popen(
+            ['dbus-daemon', '--session', '--nofork', '--print-address=1'],
+            stdout=subprocess.PIPE, universal_newlines=True)
+        self.address = self.daemon.stdout.readline().strip()
+
+        self.env = {
+            'DBUS_SESSION_BUS_ADDRESS': self.address,
+            'DBUS_SYSTEM_BUS_ADDRESS': self.address,
+        }
+
+        env = dict(os.environ)
+        env.update(self.env)
+        self.mock = subprocess.Popen(
+            [mock,
+             '--extensions', str(extensions),
+             '--sessions', str(sessions),
+             '--latency-ms', str(latency_ms),
+             '--churn-ms', str(churn_ms)],
+            env=env, stdout=subprocess.PIPE, universal_newlines=True)
+
+        if self.mock.stdout.readline().strip() != 'READY':
+            self.close()
+            raise RuntimeError('deap-mock-bus did not come up')
+
+    def close(self):
+        for proc in (self.mock, self.daemon):
+            if proc.poll() is None:
+                proc.terminate()
+                proc.wait()
+
+
+def wrap_command(deap, metrics_path):
+    command = [deap, '--dump-metrics=' + metrics_path]
+
+    if not os.environ.get('DISPLAY') and not os.environ.get('WAYLAND_DISPLAY'):
+        xvfb_run = shutil.which('xvfb-run')
+        if xvfb_run is None:
+            return None
+        command = [xvfb_run, '-a'] + command
+
+    return command
+
+
+def remove_metrics(path):
+    try:
+        os.unlink(path)
+    except FileNotFoundError:
+        pass
+
+
+def read_metrics(path):
+    # A run which died before dumping leaves no file, so it adds no samples
+    try:
+        with open(path) as f:
+            return json.load(f)['metrics']
+    except (OSError, ValueError, KeyError):
+        return {}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='deap mock-bus benchmark')
+    parser.add_argument('deap', help='path to the deap executable')
+    parser.add_argument('--mock', required=True,
+                        help='path to the deap-mock-bus executable')
+    parser.add_argument('--extensions', type=int, default=1000)
+    parser.add_argument('--sessions', type=int, default=10000)
+    parser.add_argument('--latency-ms', type=int, default=0,
+                        help='delay of every mocked method reply')
+    parser.add_argument('--churn-ms', type=int, default=0,
+                        help='interval of SessionNew/SessionRemoved and '
+                             'ExtensionStateChanged signals, 0 for none')
+    parser.add_argument('--runs', type=int,
+                        default=int(os.environ.get('DEAP_BENCH_RUNS', '5')))
+    parser.add_argument('--timeout', type=float, default=60.0,
+                        help='seconds to wait for one run')
+    parser.add_argument('--output', help='write the JSON report here as well')
+    args = parser.parse_args()
+
+    with tempfile.NamedTemporaryFile(prefix='deap-metrics-', suffix='.json',
+                                     delete=False) as f:
+        metrics_path = f.name
+
+    command = wrap_command(args.deap, metrics_path)
+    if command is None or shutil.which('dbus-daemon') is None:
+        remove_metrics(metrics_path)
+        print(json.dumps({'skipped': 'no display or dbus-daemon'}))
+        return SKIP
+
+    bus = MockBus(args.mock, args.extensions, args.sessions,
+                  args.latency_ms, args.churn_ms)
+
+    samples = {}
+    try:
+        for _ in range(args.runs):
+            # Never read the previous run's dump back
+            remove_metrics(metrics_path)
+            phases = run_once(command, args.timeout, bus.env)
+            for phase in PAGES:
+                if phase in phases:
+                    samples.setdefault(phase + ' (ms)', []).append(phases[phase])
+
+            metrics = read_metrics(metrics_path)
+            peak = metrics.get('process.peak_rss_bytes', {}).get('value')
+            if peak is not None:
+                samples.setdefault('peak-rss (MiB)', []).append(peak / 1048576.0)
+
+            stall = metrics.get('mainloop.stall')
+            if stall is not None:
+                samples.setdefault('stall-max (ms)', []).append(stall['max'] / 1000.0)
+                samples.setdefault('stall-p99 (ms)', []).append(stall['p99'] / 1000.0)
+                samples.setdefault('stall-total (ms)', []).append(stall['sum'] / 1000.0)
+    finally:
+        bus.close()
+        remove_metrics(metrics_path)
+
+    report = {
+        'benchmark': 'mock-bus',
+        'extensions': args.extensions,
+        'sessions': args.sessions,
+        'latency_ms': args.latency_ms,
+        'churn_ms': args.churn_ms,
+        'runs': args.runs,
+        'results': {name: summarize(values) for name, values in samples.items()},
+    }
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    print(text)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+
+    return 0 if all(phase + ' (ms)' in samples for phase in PAGES) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
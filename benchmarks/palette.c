@@ -0,0 +1,143 @@
+/* palette.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Microbenchmark of DeapPaletteIndex, the command palette's search index
+ *
+ *  - build: bulk insertion of 10 to 100k extension-like keys
+ *  - query: a few fuzzy queries of MAX_RESULTS matches each
+ *  - churn: every key removed and inserted again under a new name, one
+ *    at a time as DeapLogin1's session-* signals would do it
+ *  - query after churn, which must not degrade with the removals
+ *
+ * Results are ns per entry for build and churn, and µs per query, as
+ * JSON on stdout. "dead" is the number of removed keys the index still
+ * carries after the churn.
+ */
+
+#include "deap-config.h"
+#include "deap-palette-index.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_RESULTS       50
+#define QUERY_ITERATIONS  20
+
+static const guint sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+static const gchar *queries[] = {
+  "bench",
+  "ext 42",
+  "example org",
+  "synthetic 7",
+  "zzz",
+};
+
+
+static gchar *
+new_key (guint i,
+         guint generation)
+{
+  return g_strdup_printf ("Benchmark Extension %u bench-%u-%u@deap.example.org "
+                          "Synthetic palette entry",
+                          i, i, generation);
+}
+
+/* µs per query, over every query QUERY_ITERATIONS times */
+static gdouble
+time_queries (DeapPaletteIndex *index)
+{
+  gint64 begin;
+  guint i;
+  guint j;
+
+  begin = g_get_monotonic_time ();
+
+  for (i = 0; i < QUERY_ITERATIONS; i++) {
+    for (j = 0; j < G_N_ELEMENTS (queries); j++) {
+      g_autoptr(GPtrArray) matches = deap_palette_index_match (index, queries[j], MAX_RESULTS);
+    }
+  }
+
+  return (gdouble) (g_get_monotonic_time () - begin) / (QUERY_ITERATIONS * G_N_ELEMENTS (queries));
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  guint i;
+
+  printf ("{\n  \"benchmark\": \"palette\",\n  \"results\": [");
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    g_autoptr(DeapPaletteIndex) index = NULL;
+    g_autoptr(GPtrArray) keys = NULL;
+    gint64 build_usec;
+    gint64 churn_usec;
+    gdouble query_usec;
+    gdouble churned_query_usec;
+    gint64 begin;
+    guint j;
+
+    keys = g_ptr_array_new_with_free_func (g_free);
+    for (j = 0; j < sizes[i]; j++)
+      g_ptr_array_add (keys, new_key (j, 0));
+
+    index = deap_palette_index_new (NULL);
+
+    begin = g_get_monotonic_time ();
+    deap_palette_index_begin_bulk_insert (index);
+    for (j = 0; j < sizes[i]; j++)
+      deap_palette_index_insert (index, g_ptr_array_index (keys, j), GUINT_TO_POINTER (j + 1));
+    deap_palette_index_end_bulk_insert (index);
+    build_usec = g_get_monotonic_time () - begin;
+
+    query_usec = time_queries (index);
+
+    /* The new keys are made outside the clock */
+    churn_usec = 0;
+    for (j = 0; j < sizes[i]; j++) {
+      g_autofree gchar *key = new_key (j, 1);
+
+      begin = g_get_monotonic_time ();
+      deap_palette_index_remove (index, g_ptr_array_index (keys, j));
+      deap_palette_index_insert (index, key, GUINT_TO_POINTER (j + 1));
+      churn_usec += g_get_monotonic_time () - begin;
+    }
+
+    churned_query_usec = time_queries (index);
+
+    printf ("%s\n    {\"entries\": %u, \"build_ns_per_entry\": %.1f, "
+            "\"query_us\": %.1f, \"churn_ns_per_entry\": %.1f, "
+            "\"churned_query_us\": %.1f, \"dead\": %u}",
+            i == 0 ? "" : ",", sizes[i],
+            build_usec * 1000.0 / sizes[i],
+            query_usec,
+            churn_usec * 1000.0 / sizes[i],
+            churned_query_usec,
+            deap_palette_index_get_n_dead (index));
+  }
+
+  printf ("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/* parsers.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Microbenchmark of the D-Bus reply parsers
+ *
+ *  - deap_shell_extension_parse_list(), the a{sa{sv}} of ListExtensions
+ *  - deap_login1_session_parse_list(), the a(susso) of ListSessions
+ *
+ * Each is fed synthetic replies of 10 to 100k entries, in serialized
+ * form like a reply off the wire, and timed over enough iterations to
+ * parse at least MIN_ENTRIES entries after one warm-up. Iterations run
+ * in batches of about BATCH_ENTRIES entries, whose results are freed
+ * outside the clock. Results are ns and heap allocations per entry, as
+ * JSON on stdout.
+ *
+ * The ListExtensions reply is the one tests/test-shell-extension.c
+ * checks, from tests/deap-fixtures.c. Allocations are counted by
+ * tests/deap-alloc-count.c, which needs glibc; elsewhere they are
+ * reported as null.
+ */
+
+#include "deap-config.h"
+#include "deap-alloc-count.h"
+#include "deap-fixtures.h"
+#include "deap-login1-session.h"
+#include "deap-shell-extension.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN_ENTRIES     (1000 * 1000)
+#define MIN_ITERATIONS  5
+#define BATCH_ENTRIES   (100 * 1000)
+
+static const guint sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+
+typedef struct
+{
+  GPtrArray    *extensions;
+
+  GArray       *sessions;
+  GStringChunk *session_strings;
+  GHashTable   *session_index;
+} ParseResult;
+
+typedef void (*ParseFunc) (GVariant    *reply,
+                           ParseResult *result);
+
+static void
+clear_result (ParseResult *result)
+{
+  g_clear_pointer (&result->extensions, g_ptr_array_unref);
+  g_clear_pointer (&result->session_index, g_hash_table_unref);
+  g_clear_pointer (&result->sessions, g_array_unref);
+  g_clear_pointer (&result->session_strings, g_string_chunk_free);
+}
+
+/* Serialized, as g_dbus_message_get_body() would hand it over */
+static GVariant *
+serialize (GVariant *value)
+{
+  g_autoptr(GVariant) sunk = g_variant_ref_sink (value);
+  g_autoptr(GBytes) bytes = g_variant_get_data_as_bytes (sunk);
+
+  return g_variant_ref_sink (g_variant_new_from_bytes (g_variant_get_type (sunk), bytes, FALSE));
+}
+
+
+/* --- a{sa{sv}} --- */
+static void
+parse_extension_list (GVariant    *reply,
+                      ParseResult *result)
+{
+  result->extensions = deap_shell_extension_parse_list (reply);
+}
+/* --- End of a{sa{sv}} --- */
+
+
+/* --- a(susso) --- */
+static GVariant *
+new_session_list (guint n_entries)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(susso)"));
+
+  for (i = 0; i < n_entries; i++) {
+    g_autofree gchar *session_id = g_strdup_printf ("%u", i + 1);
+    g_autofree gchar *user_name = g_strdup_printf ("user%u", i % 64);
+    g_autofree gchar *path = g_strdup_printf ("/org/freedesktop/login1/session/_3%u", i + 1);
+
+    g_variant_builder_add (&builder, "(susso)", session_id, 1000 + i % 64, user_name, "seat0", path);
+  }
+
+  return serialize (g_variant_builder_end (&builder));
+}
+
+/* Includes the containers, which DeapLogin1 creates for every ListSessions */
+static void
+parse_session_list (GVariant    *reply,
+                    ParseResult *result)
+{
+  result->sessions = g_array_sized_new (FALSE, TRUE, sizeof (DeapLogin1Session),
+                                        g_variant_n_children (reply));
+  result->session_strings = g_string_chunk_new (1024);
+  result->session_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  deap_login1_session_parse_list (reply,
+                                  result->sessions,
+                                  result->session_strings,
+                                  result->session_index);
+}
+/* --- End of a(susso) --- */
+
+
+static void
+run_parser (const gchar *signature,
+            GVariant    *(*new_reply) (guint),
+            ParseFunc    parse,
+            gboolean    *first)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    g_autoptr(GVariant) reply = new_reply (sizes[i]);
+    g_autofree ParseResult *results = NULL;
+    ParseResult warmup = { NULL, };
+    guint64 allocations = 0;
+    gint64 usec = 0;
+    guint64 n_entries;
+    guint iterations;
+    guint batch;
+    guint done;
+
+    iterations = MAX (MIN_ITERATIONS, MIN_ENTRIES / sizes[i]);
+    batch = MAX (1, BATCH_ENTRIES / sizes[i]);
+    n_entries = (guint64) iterations * sizes[i];
+
+    /* Interns the UUIDs and faults the reply in */
+    parse (reply, &warmup);
+    clear_result (&warmup);
+
+    results = g_new0 (ParseResult, batch);
+
+    for (done = 0; done < iterations; ) {
+      guint n = MIN (batch, iterations - done);
+      gint64 begin;
+      guint j;
+
+      deap_alloc_count_begin ();
+      begin = g_get_monotonic_time ();
+
+      for (j = 0; j < n; j++)
+        parse (reply, &results[j]);
+
+      usec += g_get_monotonic_time () - begin;
+      allocations += deap_alloc_count_end ();
+
+      for (j = 0; j < n; j++)
+        clear_result (&results[j]);
+
+      done += n;
+    }
+
+    printf ("%s\n    {\"parser\": \"%s\", \"entries\": %u, \"iterations\": %u, "
+            "\"ns_per_entry\": %.1f, ",
+            *first ? "" : ",", signature, sizes[i], iterations,
+            usec * 1000.0 / n_entries);
+    if (deap_alloc_count_is_supported ())
+      printf ("\"allocs_per_entry\": %.2f}", (gdouble) allocations / n_entries);
+    else
+      printf ("\"allocs_per_entry\": null}");
+
+    *first = FALSE;
+  }
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  gboolean first = TRUE;
+
+  g_type_ensure (DEAP_TYPE_SHELL_EXTENSION);
+
+  printf ("{\n  \"benchmark\": \"parsers\",\n  \"unit\": \"ns\",\n  \"results\": [");
+
+  run_parser ("a{sa{sv}}", deap_fixtures_new_extension_list, parse_extension_list, &first);
+  run_parser ("a(susso)", new_session_list, parse_session_list, &first);
+
+  printf ("\n  ]\n}\n");
+
+  return EXIT_SUCCESS;
+}
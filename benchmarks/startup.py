@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# Time-to-first-frame startup benchmark.
+#
+# Launches deap N times, each under a private session bus, with
+# DEAP_PROFILE_STARTUP set and collects the DEAP-MARK lines written by
+# src/deap-profile.c. Every phase is reported in milliseconds from the
+# moment the process was spawned, as JSON on stdout.
+#
+# Every run gets an empty XDG_CACHE_HOME of its own, so it is a cold
+# start which neither reads nor overwrites the user's extension cache.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+SKIP = 77
+
+
+def percentile(values, pct):
+    values = sorted(values)
+    if not values:
+        return None
+    k = (len(values) - 1) * pct / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(values) - 1)
+    return values[lo] + (values[hi] - values[lo]) * (k - lo)
+
+
+def summarize(values):
+    return {
+        'samples': len(values),
+        'min': min(values),
+        'median': percentile(values, 50),
+        'p90': percentile(values, 90),
+        'p99': percentile(values, 99),
+        'max': max(values),
+    }
+
+
+def wrap_command(deap):
+    command = [deap]
+
+    if not os.environ.get('DISPLAY') and not os.environ.get('WAYLAND_DISPLAY'):
+        xvfb_run = shutil.which('xvfb-run')
+        if xvfb_run is None:
+            return None
+        command = [xvfb_run, '-a'] + command
+
+    dbus_run_session = shutil.which('dbus-run-session')
+    if dbus_run_session is None:
+        return None
+
+    return [dbus_run_session, '--'] + command
+
+
+def run_once(command, timeout, extra_env):
+    with tempfile.NamedTemporaryFile(prefix='deap-marks-', delete=False) as f:
+        marks_path = f.name
+
+    cache_dir = tempfile.mkdtemp(prefix='deap-cache-')
+
+    env = dict(os.environ)
+    env.update(extra_env)
+    env['DEAP_PROFILE_STARTUP'] = marks_path
+    env['XDG_CACHE_HOME'] = cache_dir
+
+    start = time.monotonic_ns() // 1000
+    proc = subprocess.Popen(command, env=env,
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    try:
+        proc.wait(timeout=timeout)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+
+    phases = {}
+    with open(marks_path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 3 or fields[0] != 'DEAP-MARK':
+                continue
+            phases.setdefault(fields[1], (int(fields[2]) - start) / 1000.0)
+    os.unlink(marks_path)
+    shutil.rmtree(cache_dir, ignore_errors=True)
+
+    return phases
+
+
+def main():
+    parser = argparse.ArgumentParser(description='deap startup benchmark')
+    parser.add_argument('deap', help='path to the deap executable')
+    parser.add_argument('--runs', type=int,
+                        default=int(os.environ.get('DEAP_BENCH_RUNS', '10')))
+    parser.add_argument('--timeout', type=float, default=30.0,
+                        help='seconds to wait for one run')
+    parser.add_argument('--output', help='write the JSON report here as well')
+    args = parser.parse_args()
+
+    command = wrap_command(args.deap)
+    if command is None:
+        print(json.dumps({'skipped': 'no display or dbus-run-session'}))
+        return SKIP
+
+    samples = {}
+    for _ in range(args.runs):
+        for phase, value in run_once(command, args.timeout, {}).items():
+            samples.setdefault(phase, []).append(value)
+
+    report = {
+        'benchmark': 'startup',
+        'unit': 'ms',
+        'runs': args.runs,
+        'phases': {phase: summarize(values) for phase, values in samples.items()},
+    }
+
+    text = json.dumps(report, indent=2, sort_keys=True)
+    print(text)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+
+    return 0 if 'first-frame' in samples else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -18,35 +18,94 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#define G_LOG_DOMAIN "DeapApplication"
+
 #include "deap-config.h"
 #include "deap-debug.h"
 #include "deap-application.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
+#include "deap-shell-actions.h"
 #include "deap-window.h"
 
+#include "deap-flight-recorder.h"
 #include "gtd-log.h"
 
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gi18n.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 struct _DeapApplication
 {
   DzlApplication    parent_instance;
   
   GtkWidget         *window;
+
+  GSettings         *settings;
 };
 
 G_DEFINE_TYPE (DeapApplication, deap_application, DZL_TYPE_APPLICATION)
 
+static void
+on_log_levels_changed_cb (GSettings   *settings,
+                          const gchar *key,
+                          gpointer     user_data)
+{
+  g_autofree gchar *spec = NULL;
+
+  spec = g_settings_get_string (settings, key);
+  deap_log_set_levels (DEAP_LOG_SOURCE_SETTINGS, spec);
+}
+
+static void
+setup_settings (DeapApplication *self)
+{
+  g_autoptr(GSettingsSchema) schema = NULL;
+  GSettingsSchemaSource *source;
+
+  /* Not installed, e.g. when running from the build directory */
+  source = g_settings_schema_source_get_default ();
+  if (source != NULL)
+    schema = g_settings_schema_source_lookup (source, "com.github.memnoth.Deap", TRUE);
+  if (schema == NULL || !g_settings_schema_has_key (schema, "log-levels"))
+    return;
+
+  self->settings = g_settings_new_full (schema, NULL, NULL);
+  g_signal_connect (self->settings,
+                    "changed::log-levels",
+                    G_CALLBACK (on_log_levels_changed_cb),
+                    self);
+  on_log_levels_changed_cb (self->settings, "log-levels", self);
+}
+
 static void
 deap_application_startup (GApplication *application)
 {
   DeapApplication *self = DEAP_APPLICATION (application);
-  
+  g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_profile_mark ("application-startup");
+
+  if (!deap_flight_recorder_init (&error))
+    deap_warn_msg ("Flight recorder is not available: %s", error->message);
+
+  setup_settings (self);
+
   G_APPLICATION_CLASS (deap_application_parent_class)->startup (application);
+
+  deap_shell_actions_install (GTK_APPLICATION (application));
+  gtk_application_set_accels_for_action (GTK_APPLICATION (application),
+                                         "win.command-palette",
+                                         (const gchar *[]) { "<Primary>k", NULL });
   
   /* Window */
   self->window = deap_window_new (self);
+
+  deap_profile_mark ("window-new");
+  deap_profile_watch_first_frame (self->window);
 }
 
 static void
@@ -59,12 +118,53 @@ deap_application_activate (GApplication *application)
   gtk_window_present (GTK_WINDOW (self->window));
 }
 
+static void
+deap_application_shutdown (GApplication *application)
+{
+  DeapApplication *self = DEAP_APPLICATION (application);
+
+  G_APPLICATION_CLASS (deap_application_parent_class)->shutdown (application);
+
+  g_clear_object (&self->settings);
+
+  deap_metrics_shutdown ();
+  deap_trace_shutdown ();
+  deap_flight_recorder_shutdown ();
+}
+
 static gint
 deap_application_handle_local_options (GApplication *application,
                                        GVariantDict *options)
 {
-  if (g_variant_dict_contains (options, "debug"))
+  g_autofree gchar *flight_recorder_path = NULL;
+  g_autofree gchar *trace_path = NULL;
+  g_autofree gchar *metrics_path = NULL;
+  const gchar *log_levels;
+
+  if (g_variant_dict_lookup (options, "dump-flight-recorder", "^ay", &flight_recorder_path)) {
+    g_autoptr(GError) error = NULL;
+
+    if (!deap_flight_recorder_dump (flight_recorder_path, STDOUT_FILENO, &error)) {
+      g_printerr ("%s\n", error->message);
+      return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  if (g_variant_dict_contains (options, "debug")) {
+    deap_log_set_levels (DEAP_LOG_SOURCE_DEBUG_OPTION, "trace");
     gtd_log_init ();
+  }
+
+  if (g_variant_dict_lookup (options, "log-levels", "&s", &log_levels))
+    deap_log_set_levels (DEAP_LOG_SOURCE_COMMAND_LINE, log_levels);
+
+  if (g_variant_dict_lookup (options, "trace-file", "^ay", &trace_path))
+    deap_trace_init (trace_path);
+
+  if (g_variant_dict_lookup (options, "dump-metrics", "^ay", &metrics_path))
+    deap_metrics_set_dump_path (metrics_path);
 
   return -1;
 }
@@ -76,6 +176,7 @@ deap_application_class_init (DeapApplicationClass *klass)
   
   application_class->startup = deap_application_startup;
   application_class->activate = deap_application_activate;
+  application_class->shutdown = deap_application_shutdown;
   application_class->handle_local_options = deap_application_handle_local_options;
 }
 
@@ -84,6 +185,14 @@ deap_application_init (DeapApplication *self)
 {
   static GOptionEntry command_options[] = {
       { "debug", 'd', 0, G_OPTION_ARG_NONE, NULL, N_("Enable debug mode"), NULL },
+      { "log-levels", 0, 0, G_OPTION_ARG_STRING, NULL,
+        N_("Comma separated DOMAIN=LEVEL pairs, e.g. DeapLogin1=trace,*=warning"), N_("SPEC") },
+      { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+        N_("Write spans as Chrome trace-event JSON to FILE on exit"), N_("FILE") },
+      { "dump-metrics", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+        N_("Write metrics as JSON to FILE on exit, - for standard output"), N_("FILE") },
+      { "dump-flight-recorder", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+        N_("Decode a flight recorder ring, e.g. $XDG_RUNTIME_DIR/deap/flight-recorder.ring.old"), N_("FILE") },
       { NULL }
   };
   
@@ -0,0 +1,684 @@
+/* deap-bus-manager.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapBusManager"
+
+#include "deap-config.h"
+#include "deap-bus-manager.h"
+#include "deap-debug.h"
+#include "deap-metrics.h"
+
+/*
+ * DeapBusManager owns one GDBusConnection per bus and hands out cached
+ * proxies keyed by (bus, name, path, interface). Every name a proxy was
+ * handed out for is watched:
+ *
+ *  - "name-vanished::<name>" is emitted when its owner goes away, and
+ *  - "name-appeared::<name>" once a new owner shows up, after the cached
+ *    proxies of the name were dropped. Pages then ask for their proxies
+ *    again (getting fresh ones) and re-sync what they display.
+ *
+ * The connections are private ones which do not exit the process when
+ * closed; a closed bus is reconnected with exponential backoff, and its
+ * names come back through "name-appeared" the same way.
+ */
+
+#define RETRY_INITIAL_MSEC    250
+#define RETRY_MAX_MSEC        (30 * 1000)
+#define PROXY_MAX_ATTEMPTS    6
+
+typedef struct
+{
+  DeapBusManager  *manager;
+  GBusType         bus_type;
+
+  GDBusConnection *connection;
+  gulong           closed_handler_id;
+  gboolean         connecting;
+
+  /* GTasks of proxy requests waiting for the connection */
+  GQueue           waiting;
+
+  guint            reconnect_source_id;
+  guint            reconnect_delay;
+} BusState;
+
+typedef struct
+{
+  BusState  *bus;
+  gchar     *name;
+  guint      watch_id;
+  gchar     *owner;
+
+  /* The first callback only reports the initial state */
+  gboolean   initialized;
+} NameWatch;
+
+typedef struct
+{
+  GBusType         bus_type;
+  GType            proxy_type;
+  GDBusProxyFlags  flags;
+  gchar           *name;
+  gchar           *object_path;
+  gchar           *interface_name;
+  gchar           *key;
+  guint            attempt;
+  gint64           begin;
+} ProxyRequest;
+
+struct _DeapBusManager
+{
+  GObject       parent_instance;
+
+  BusState      system_bus;
+  BusState      session_bus;
+
+  /* "<bus>:<name>:<path>:<interface>" -> GDBusProxy */
+  GHashTable   *proxies;
+
+  /* "<bus>:<name>" -> NameWatch */
+  GHashTable   *watches;
+};
+
+enum {
+  NAME_APPEARED,
+  NAME_VANISHED,
+  N_SIGNALS
+};
+
+static guint signals [N_SIGNALS];
+
+G_DEFINE_TYPE (DeapBusManager, deap_bus_manager, G_TYPE_OBJECT)
+
+
+static void connect_bus  (BusState *bus);
+static void create_proxy (GTask    *task);
+
+static BusState *
+get_bus (DeapBusManager *self,
+         GBusType        bus_type)
+{
+  if (bus_type == G_BUS_TYPE_SYSTEM)
+    return &self->system_bus;
+
+  return &self->session_bus;
+}
+
+static void
+proxy_request_free (gpointer data)
+{
+  ProxyRequest *req = data;
+
+  g_free (req->name);
+  g_free (req->object_path);
+  g_free (req->interface_name);
+  g_free (req->key);
+  g_free (req);
+}
+
+static void
+name_watch_free (gpointer data)
+{
+  NameWatch *watch = data;
+
+  if (watch->watch_id)
+    g_bus_unwatch_name (watch->watch_id);
+
+  g_free (watch->name);
+  g_free (watch->owner);
+  g_free (watch);
+}
+
+static void
+drop_proxies (DeapBusManager *self,
+              GBusType        bus_type,
+              const gchar    *name)
+{
+  g_autofree gchar *prefix = NULL;
+  GHashTableIter iter;
+  gpointer key;
+
+  if (name != NULL)
+    prefix = g_strdup_printf ("%d:%s:", bus_type, name);
+  else
+    prefix = g_strdup_printf ("%d:", bus_type);
+
+  g_hash_table_iter_init (&iter, self->proxies);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    if (g_str_has_prefix (key, prefix))
+      g_hash_table_iter_remove (&iter);
+  }
+}
+
+
+/* --- Name Watching --- */
+static void
+on_name_appeared (GDBusConnection *connection,
+                  const gchar     *name,
+                  const gchar     *name_owner,
+                  gpointer         user_data)
+{
+  NameWatch *watch = user_data;
+  DeapBusManager *self = watch->bus->manager;
+  gboolean initial;
+
+  initial = !watch->initialized;
+  watch->initialized = TRUE;
+
+  if (g_strcmp0 (watch->owner, name_owner) == 0)
+    return;
+
+  g_free (watch->owner);
+  watch->owner = g_strdup (name_owner);
+
+  if (initial)
+    return;
+
+  deap_info_msg ("%s is now owned by %s", name, name_owner);
+
+  /* The cached proxies still carry the old owner's state */
+  drop_proxies (self, watch->bus->bus_type, name);
+
+  g_signal_emit (self, signals [NAME_APPEARED], g_quark_from_string (name), watch->bus->bus_type, name);
+}
+
+static void
+on_name_vanished (GDBusConnection *connection,
+                  const gchar     *name,
+                  gpointer         user_data)
+{
+  NameWatch *watch = user_data;
+  DeapBusManager *self = watch->bus->manager;
+
+  watch->initialized = TRUE;
+
+  if (watch->owner == NULL)
+    return;
+
+  g_clear_pointer (&watch->owner, g_free);
+
+  deap_info_msg ("%s vanished", name);
+
+  g_signal_emit (self, signals [NAME_VANISHED], g_quark_from_string (name), watch->bus->bus_type, name);
+}
+
+static void
+start_watch (NameWatch *watch)
+{
+  g_return_if_fail (watch->watch_id == 0);
+  g_return_if_fail (watch->bus->connection != NULL);
+
+  watch->watch_id = g_bus_watch_name_on_connection (watch->bus->connection,
+                                                    watch->name,
+                                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    on_name_appeared,
+                                                    on_name_vanished,
+                                                    watch,
+                                                    NULL);
+}
+
+static void
+ensure_watch (DeapBusManager *self,
+              BusState       *bus,
+              const gchar    *name)
+{
+  g_autofree gchar *key = NULL;
+  NameWatch *watch;
+
+  key = g_strdup_printf ("%d:%s", bus->bus_type, name);
+  watch = g_hash_table_lookup (self->watches, key);
+
+  if (watch == NULL) {
+    watch = g_new0 (NameWatch, 1);
+    watch->bus = bus;
+    watch->name = g_strdup (name);
+    g_hash_table_insert (self->watches, g_steal_pointer (&key), watch);
+  }
+
+  if (watch->watch_id == 0 && bus->connection != NULL)
+    start_watch (watch);
+}
+/* --- End of Name Watching --- */
+
+
+/* --- Connections --- */
+static gboolean
+bus_has_watches (BusState *bus)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, bus->manager->watches);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (((NameWatch *) value)->bus == bus)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+reconnect_cb (gpointer user_data)
+{
+  BusState *bus = user_data;
+
+  bus->reconnect_source_id = 0;
+  connect_bus (bus);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_reconnect (BusState *bus)
+{
+  if (bus->reconnect_source_id)
+    return;
+
+  if (bus->reconnect_delay == 0)
+    bus->reconnect_delay = RETRY_INITIAL_MSEC;
+
+  deap_debug_msg ("Reconnecting bus %d in %u ms", bus->bus_type, bus->reconnect_delay);
+
+  bus->reconnect_source_id = g_timeout_add (bus->reconnect_delay, reconnect_cb, bus);
+  bus->reconnect_delay = MIN (bus->reconnect_delay * 2, RETRY_MAX_MSEC);
+}
+
+static void
+on_connection_closed (GDBusConnection *connection,
+                      gboolean         remote_peer_vanished,
+                      GError          *error,
+                      gpointer         user_data)
+{
+  BusState *bus = user_data;
+  DeapBusManager *self = bus->manager;
+  GHashTableIter iter;
+  gpointer value;
+
+  deap_warn_msg ("Connection to bus %d closed: %s",
+                 bus->bus_type, error ? error->message : "no reason given");
+
+  g_signal_handler_disconnect (bus->connection, bus->closed_handler_id);
+  bus->closed_handler_id = 0;
+  g_clear_object (&bus->connection);
+
+  drop_proxies (self, bus->bus_type, NULL);
+
+  g_hash_table_iter_init (&iter, self->watches);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    NameWatch *watch = value;
+
+    if (watch->bus != bus)
+      continue;
+
+    if (watch->watch_id) {
+      g_bus_unwatch_name (watch->watch_id);
+      watch->watch_id = 0;
+    }
+
+    if (watch->owner != NULL)
+      on_name_vanished (NULL, watch->name, watch);
+  }
+
+  schedule_reconnect (bus);
+}
+
+static void
+connection_ready_cb (GObject      *source,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  BusState *bus = user_data;
+  g_autoptr(GError) error = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  GTask *task;
+
+  bus->connecting = FALSE;
+  bus->connection = g_dbus_connection_new_for_address_finish (res, &error);
+
+  if (error) {
+    deap_warn_msg ("Error connecting to bus %d: %s", bus->bus_type, error->message);
+
+    while ((task = g_queue_pop_head (&bus->waiting))) {
+      g_task_return_error (task, g_error_copy (error));
+      g_object_unref (task);
+    }
+
+    /* Names were watched on it, so pages wait for it to come back */
+    if (bus_has_watches (bus))
+      schedule_reconnect (bus);
+
+    return;
+  }
+
+  deap_debug_msg ("Connected to bus %d", bus->bus_type);
+  deap_metrics_counter_add (bus->bus_type == G_BUS_TYPE_SYSTEM ? "dbus.connects.system" : "dbus.connects.session", 1);
+
+  bus->reconnect_delay = 0;
+
+  g_dbus_connection_set_exit_on_close (bus->connection, FALSE);
+  bus->closed_handler_id = g_signal_connect (bus->connection,
+                                             "closed",
+                                             G_CALLBACK (on_connection_closed),
+                                             bus);
+
+  while ((task = g_queue_pop_head (&bus->waiting)))
+    create_proxy (task);
+
+  /* Names watched on the previous connection */
+  g_hash_table_iter_init (&iter, bus->manager->watches);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    NameWatch *watch = value;
+
+    if (watch->bus == bus && watch->watch_id == 0)
+      start_watch (watch);
+  }
+}
+
+static void
+connect_bus (BusState *bus)
+{
+  g_autofree gchar *address = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (bus->connection != NULL || bus->connecting)
+    return;
+
+  address = g_dbus_address_get_for_bus_sync (bus->bus_type, NULL, &error);
+  if (address == NULL) {
+    GTask *task;
+
+    deap_warn_msg ("No address for bus %d: %s", bus->bus_type, error->message);
+
+    while ((task = g_queue_pop_head (&bus->waiting))) {
+      g_task_return_error (task, g_error_copy (error));
+      g_object_unref (task);
+    }
+    return;
+  }
+
+  bus->connecting = TRUE;
+  g_dbus_connection_new_for_address (address,
+                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                     G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                     NULL,
+                                     NULL,
+                                     connection_ready_cb,
+                                     bus);
+}
+/* --- End of Connections --- */
+
+
+/* --- Proxies --- */
+static gboolean
+retry_proxy_cb (gpointer user_data)
+{
+  GTask *task = user_data;
+
+  if (g_task_return_error_if_cancelled (task)) {
+    g_object_unref (task);
+    return G_SOURCE_REMOVE;
+  }
+
+  create_proxy (task);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+proxy_ready_cb (GObject      *source,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  GTask *task = user_data;
+  DeapBusManager *self = g_task_get_source_object (task);
+  ProxyRequest *req = g_task_get_task_data (task);
+  g_autoptr(GError) error = NULL;
+  GObject *proxy;
+
+  proxy = g_async_initable_new_finish (G_ASYNC_INITABLE (source), res, &error);
+
+  if (error) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+        req->attempt < PROXY_MAX_ATTEMPTS) {
+      guint delay = MIN (RETRY_INITIAL_MSEC << req->attempt, RETRY_MAX_MSEC);
+
+      deap_debug_msg ("Retrying %s proxy in %u ms: %s", req->interface_name, delay, error->message);
+
+      req->attempt++;
+      g_timeout_add (delay, retry_proxy_cb, task);
+      return;
+    }
+
+    g_task_return_error (task, g_steal_pointer (&error));
+    g_object_unref (task);
+    return;
+  }
+
+  {
+    g_autofree gchar *metric = g_strconcat ("dbus.proxy.", req->interface_name, NULL);
+
+    deap_metrics_histogram_record (metric, g_get_monotonic_time () - req->begin);
+  }
+
+  g_hash_table_replace (self->proxies, g_strdup (req->key), g_object_ref (proxy));
+  ensure_watch (self, get_bus (self, req->bus_type), req->name);
+
+  g_task_return_pointer (task, proxy, g_object_unref);
+  g_object_unref (task);
+}
+
+/* Takes over the reference of @task */
+static void
+create_proxy (GTask *task)
+{
+  DeapBusManager *self = g_task_get_source_object (task);
+  ProxyRequest *req = g_task_get_task_data (task);
+  BusState *bus = get_bus (self, req->bus_type);
+
+  if (bus->connection == NULL) {
+    g_queue_push_tail (&bus->waiting, task);
+    connect_bus (bus);
+    return;
+  }
+
+  g_async_initable_new_async (req->proxy_type,
+                              G_PRIORITY_DEFAULT,
+                              g_task_get_cancellable (task),
+                              proxy_ready_cb,
+                              task,
+                              "g-flags", req->flags,
+                              "g-name", req->name,
+                              "g-connection", bus->connection,
+                              "g-object-path", req->object_path,
+                              "g-interface-name", req->interface_name,
+                              NULL);
+}
+
+/*
+ * deap_bus_manager_get_proxy_async
+ *
+ * @proxy_type is G_TYPE_DBUS_PROXY or a generated proxy type, e.g.
+ * DEAP_DBUS_TYPE_SHELL_PROXY. A cached proxy is handed out right away;
+ * creating a new one is retried with exponential backoff.
+ */
+void
+deap_bus_manager_get_proxy_async (DeapBusManager       *self,
+                                  GBusType              bus_type,
+                                  GType                 proxy_type,
+                                  GDBusProxyFlags       flags,
+                                  const gchar          *name,
+                                  const gchar          *object_path,
+                                  const gchar          *interface_name,
+                                  GCancellable         *cancellable,
+                                  GAsyncReadyCallback   callback,
+                                  gpointer              user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  g_autofree gchar *key = NULL;
+  ProxyRequest *req;
+  GDBusProxy *proxy;
+
+  g_return_if_fail (DEAP_IS_BUS_MANAGER (self));
+  g_return_if_fail (g_type_is_a (proxy_type, G_TYPE_DBUS_PROXY));
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (object_path != NULL);
+  g_return_if_fail (interface_name != NULL);
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, deap_bus_manager_get_proxy_async);
+
+  key = g_strdup_printf ("%d:%s:%s:%s", bus_type, name, object_path, interface_name);
+
+  proxy = g_hash_table_lookup (self->proxies, key);
+  if (proxy != NULL && G_TYPE_CHECK_INSTANCE_TYPE (proxy, proxy_type)) {
+    g_task_return_pointer (task, g_object_ref (proxy), g_object_unref);
+    return;
+  }
+
+  req = g_new0 (ProxyRequest, 1);
+  req->bus_type = bus_type;
+  req->proxy_type = proxy_type;
+  req->flags = flags;
+  req->name = g_strdup (name);
+  req->object_path = g_strdup (object_path);
+  req->interface_name = g_strdup (interface_name);
+  req->key = g_steal_pointer (&key);
+  req->begin = g_get_monotonic_time ();
+  g_task_set_task_data (task, req, proxy_request_free);
+
+  create_proxy (g_steal_pointer (&task));
+}
+
+/*
+ * deap_bus_manager_get_proxy_finish
+ *
+ * Returns: (transfer full): the proxy
+ */
+gpointer
+deap_bus_manager_get_proxy_finish (DeapBusManager  *self,
+                                   GAsyncResult    *result,
+                                   GError         **error)
+{
+  g_return_val_if_fail (DEAP_IS_BUS_MANAGER (self), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, self), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+/* --- End of Proxies --- */
+
+
+/* --- GObject --- */
+static void
+bus_state_clear (BusState *bus)
+{
+  GTask *task;
+
+  if (bus->reconnect_source_id) {
+    g_source_remove (bus->reconnect_source_id);
+    bus->reconnect_source_id = 0;
+  }
+
+  while ((task = g_queue_pop_head (&bus->waiting))) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED, "Bus manager is gone");
+    g_object_unref (task);
+  }
+
+  if (bus->connection != NULL) {
+    g_signal_handler_disconnect (bus->connection, bus->closed_handler_id);
+    g_clear_object (&bus->connection);
+  }
+}
+
+static void
+deap_bus_manager_finalize (GObject *object)
+{
+  DeapBusManager *self = DEAP_BUS_MANAGER (object);
+
+  g_clear_pointer (&self->watches, g_hash_table_unref);
+  g_clear_pointer (&self->proxies, g_hash_table_unref);
+
+  bus_state_clear (&self->system_bus);
+  bus_state_clear (&self->session_bus);
+
+  G_OBJECT_CLASS (deap_bus_manager_parent_class)->finalize (object);
+}
+
+static void
+deap_bus_manager_class_init (DeapBusManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = deap_bus_manager_finalize;
+
+  /*
+   * DeapBusManager::name-appeared:
+   *
+   * A watched name got a new owner, its cached proxies were dropped.
+   * Detailed with the bus name.
+   */
+  signals [NAME_APPEARED] =
+    g_signal_new ("name-appeared",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 2, G_TYPE_BUS_TYPE, G_TYPE_STRING);
+
+  /*
+   * DeapBusManager::name-vanished:
+   *
+   * A watched name lost its owner. Detailed with the bus name.
+   */
+  signals [NAME_VANISHED] =
+    g_signal_new ("name-vanished",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 2, G_TYPE_BUS_TYPE, G_TYPE_STRING);
+}
+
+static void
+deap_bus_manager_init (DeapBusManager *self)
+{
+  self->system_bus.manager = self;
+  self->system_bus.bus_type = G_BUS_TYPE_SYSTEM;
+  g_queue_init (&self->system_bus.waiting);
+
+  self->session_bus.manager = self;
+  self->session_bus.bus_type = G_BUS_TYPE_SESSION;
+  g_queue_init (&self->session_bus.waiting);
+
+  self->proxies = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->watches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, name_watch_free);
+}
+
+DeapBusManager *
+deap_bus_manager_get_default (void)
+{
+  static DeapBusManager *instance = NULL;
+
+  if (instance == NULL) {
+    instance = g_object_new (DEAP_TYPE_BUS_MANAGER, NULL);
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer) &instance);
+  }
+
+  return instance;
+}
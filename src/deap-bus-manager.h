@@ -0,0 +1,47 @@
+/* deap-bus-manager.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define DEAP_TYPE_BUS_MANAGER (deap_bus_manager_get_type ())
+
+G_DECLARE_FINAL_TYPE (DeapBusManager, deap_bus_manager, DEAP, BUS_MANAGER, GObject)
+
+DeapBusManager *  deap_bus_manager_get_default        (void);
+
+void              deap_bus_manager_get_proxy_async    (DeapBusManager       *self,
+                                                       GBusType              bus_type,
+                                                       GType                 proxy_type,
+                                                       GDBusProxyFlags       flags,
+                                                       const gchar          *name,
+                                                       const gchar          *object_path,
+                                                       const gchar          *interface_name,
+                                                       GCancellable         *cancellable,
+                                                       GAsyncReadyCallback   callback,
+                                                       gpointer              user_data);
+gpointer          deap_bus_manager_get_proxy_finish   (DeapBusManager       *self,
+                                                       GAsyncResult         *result,
+                                                       GError              **error);
+
+G_END_DECLS
@@ -0,0 +1,229 @@
+/* deap-call.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapCall"
+
+#include "deap-config.h"
+#include "deap-call.h"
+#include "deap-debug.h"
+#include "deap-metrics.h"
+
+/*
+ * DeapCall is the user_data of an asynchronous D-Bus call. It carries
+ * a cancellable of its own which is cancelled
+ *
+ *  - when the owner's cancellable is, i.e. on the owner's dispose, and
+ *  - when the deadline of the call's DeapCallKind passes.
+ *
+ * The callback hands its GError to deap_call_complete() first: it
+ * returns FALSE when the owner is gone (and must not be touched), and
+ * turns a passed deadline into G_IO_ERROR_TIMED_OUT, which is logged and
+ * counted instead of hanging for the 25 s default.
+ *
+ * Round trips are recorded as "dbus.call.<operation>" histograms, so
+ * operations are named "<interface>.<method>".
+ */
+
+struct _DeapCall
+{
+  const gchar   *operation;
+  DeapCallKind   kind;
+
+  gpointer       owner;
+  gpointer       data;
+
+  GCancellable  *cancellable;
+  GCancellable  *owner_cancellable;
+  gulong         owner_handler_id;
+
+  guint          deadline_source_id;
+  gboolean       timed_out;
+  gint64         begin;
+};
+
+static const guint deadlines_msec[DEAP_CALL_N_KINDS] = {
+  [DEAP_CALL_ACTION]   = 3 * 1000,
+  [DEAP_CALL_PROPERTY] = 5 * 1000,
+  [DEAP_CALL_LISTING]  = 10 * 1000,
+};
+
+static volatile gint n_timeouts[DEAP_CALL_N_KINDS];
+
+
+static gboolean
+deadline_cb (gpointer user_data)
+{
+  DeapCall *call = user_data;
+
+  call->deadline_source_id = 0;
+  call->timed_out = TRUE;
+
+  g_cancellable_cancel (call->cancellable);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+owner_cancelled_cb (GCancellable *owner_cancellable,
+                    gpointer      user_data)
+{
+  GCancellable *cancellable = user_data;
+
+  g_cancellable_cancel (cancellable);
+}
+
+/*
+ * deap_call_new
+ *
+ * @operation: (not nullable): a static string naming the call
+ * @owner: the object the callback works on
+ * @owner_cancellable: (nullable): cancelled when @owner goes away
+ */
+DeapCall *
+deap_call_new (const gchar  *operation,
+               DeapCallKind  kind,
+               gpointer      owner,
+               GCancellable *owner_cancellable)
+{
+  DeapCall *call;
+
+  g_return_val_if_fail (operation != NULL, NULL);
+  g_return_val_if_fail (kind < DEAP_CALL_N_KINDS, NULL);
+
+  call = g_new0 (DeapCall, 1);
+  call->operation = operation;
+  call->kind = kind;
+  call->owner = owner;
+  call->cancellable = g_cancellable_new ();
+  call->begin = g_get_monotonic_time ();
+
+  if (owner_cancellable != NULL) {
+    call->owner_cancellable = g_object_ref (owner_cancellable);
+    call->owner_handler_id = g_cancellable_connect (owner_cancellable,
+                                                    G_CALLBACK (owner_cancelled_cb),
+                                                    g_object_ref (call->cancellable),
+                                                    g_object_unref);
+  }
+
+  call->deadline_source_id = g_timeout_add (deadlines_msec[kind], deadline_cb, call);
+
+  return call;
+}
+
+GCancellable *
+deap_call_get_cancellable (DeapCall *call)
+{
+  g_return_val_if_fail (call != NULL, NULL);
+
+  return call->cancellable;
+}
+
+gpointer
+deap_call_get_owner (DeapCall *call)
+{
+  g_return_val_if_fail (call != NULL, NULL);
+
+  return call->owner;
+}
+
+gpointer
+deap_call_get_data (DeapCall *call)
+{
+  g_return_val_if_fail (call != NULL, NULL);
+
+  return call->data;
+}
+
+void
+deap_call_set_data (DeapCall *call,
+                    gpointer  data)
+{
+  g_return_if_fail (call != NULL);
+
+  call->data = data;
+}
+
+/*
+ * deap_call_complete
+ *
+ * Frees @call, so read its owner and data before. @error is the one the
+ * finish function set, if any.
+ *
+ * Returns: FALSE if the owner is gone; @error is cleared then.
+ */
+gboolean
+deap_call_complete (DeapCall  *call,
+                    GError   **error)
+{
+  g_autofree gchar *metric = NULL;
+  gboolean owner_alive;
+
+  g_return_val_if_fail (call != NULL, FALSE);
+
+  if (call->deadline_source_id)
+    g_source_remove (call->deadline_source_id);
+
+  owner_alive = call->owner_cancellable == NULL ||
+                !g_cancellable_is_cancelled (call->owner_cancellable);
+
+  if (call->owner_cancellable != NULL) {
+    g_cancellable_disconnect (call->owner_cancellable, call->owner_handler_id);
+    g_clear_object (&call->owner_cancellable);
+  }
+
+  if (!owner_alive) {
+    g_clear_error (error);
+  } else if (call->timed_out && error != NULL &&
+             g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    guint n;
+
+    n = (guint) g_atomic_int_add (&n_timeouts[call->kind], 1) + 1;
+
+    deap_warn_msg ("%s timed out after %u ms (%u timeouts of this kind so far)",
+                   call->operation, deadlines_msec[call->kind], n);
+
+    g_clear_error (error);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                 "%s timed out after %u ms", call->operation, deadlines_msec[call->kind]);
+
+    metric = g_strconcat ("dbus.timeouts.", call->operation, NULL);
+    deap_metrics_counter_add (metric, 1);
+  } else {
+    gint64 elapsed = g_get_monotonic_time () - call->begin;
+
+    metric = g_strconcat ("dbus.call.", call->operation, NULL);
+    deap_metrics_histogram_record (metric, elapsed);
+
+    deap_trace_msg ("%s completed in %" G_GINT64_FORMAT " us", call->operation, elapsed);
+  }
+
+  g_clear_object (&call->cancellable);
+  g_free (call);
+
+  return owner_alive;
+}
+
+guint
+deap_call_get_n_timeouts (DeapCallKind kind)
+{
+  g_return_val_if_fail (kind < DEAP_CALL_N_KINDS, 0);
+
+  return (guint) g_atomic_int_get (&n_timeouts[kind]);
+}
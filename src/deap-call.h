@@ -0,0 +1,52 @@
+/* deap-call.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Decides the deadline of a call */
+typedef enum
+{
+  DEAP_CALL_ACTION,     /* Triggered by the user, e.g. LockSession */
+  DEAP_CALL_PROPERTY,   /* A single property or GetAll */
+  DEAP_CALL_LISTING,    /* ListExtensions, ListSessions, ... */
+  DEAP_CALL_N_KINDS
+} DeapCallKind;
+
+typedef struct _DeapCall DeapCall;
+
+DeapCall *      deap_call_new                 (const gchar   *operation,
+                                               DeapCallKind   kind,
+                                               gpointer       owner,
+                                               GCancellable  *owner_cancellable);
+GCancellable *  deap_call_get_cancellable     (DeapCall      *call);
+gpointer        deap_call_get_owner           (DeapCall      *call);
+gpointer        deap_call_get_data            (DeapCall      *call);
+void            deap_call_set_data            (DeapCall      *call,
+                                               gpointer       data);
+gboolean        deap_call_complete            (DeapCall      *call,
+                                               GError       **error);
+
+guint           deap_call_get_n_timeouts      (DeapCallKind   kind);
+
+G_END_DECLS
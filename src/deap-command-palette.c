@@ -0,0 +1,563 @@
+/* deap-command-palette.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapCommandPalette"
+
+#include "deap-config.h"
+#include "deap-command-palette.h"
+#include "deap-debug.h"
+#include "deap-gnome-shell.h"
+#include "deap-login1.h"
+#include "deap-metrics.h"
+#include "deap-palette-index.h"
+#include "deap-shell-actions.h"
+#include "deap-window.h"
+
+#include <glib/gi18n.h>
+#include <string.h>
+
+/*
+ * Ctrl+K palette over the shell actions, the extensions of DeapGnomeShell
+ * and the sessions of DeapLogin1.
+ *
+ * Every entry is indexed once, under a key made of its searchable fields,
+ * in a DeapPaletteIndex. The index follows the extension model's
+ * items-changed and DeapLogin1's session-* signals, so typing only runs
+ * a match over it, never a scan of the lists. Keys are unique (they
+ * contain the UUID or the session ID) since entries are removed from the
+ * index by key. A session whose key survives a change is patched in
+ * place rather than indexed anew.
+ */
+
+#define MAX_RESULTS   50
+
+typedef enum
+{
+  PALETTE_ENTRY_ACTION,
+  PALETTE_ENTRY_EXTENSION,
+  PALETTE_ENTRY_SESSION,
+} PaletteEntryKind;
+
+typedef struct
+{
+  PaletteEntryKind    kind;
+
+  /* Indexed, and the key of DeapCommandPalette.index */
+  gchar              *key;
+
+  gchar              *title;
+  gchar              *subtitle;
+
+  /* Detailed action name or session ID */
+  gchar              *target;
+  DeapShellExtension *extension;
+} PaletteEntry;
+
+struct _DeapCommandPalette
+{
+  GtkPopover            parent_instance;
+
+  /* Widgets */
+  GtkWidget            *search_entry;
+  GtkWidget            *result_list;
+
+  /* key -> PaletteEntry, owning */
+  DeapPaletteIndex     *index;
+
+  /* Borrowed PaletteEntry, parallel to the extension model */
+  GPtrArray            *extension_entries;
+
+  /* session ID -> borrowed PaletteEntry */
+  GHashTable           *session_entries;
+
+  /* Borrowed PaletteEntry, listed for an empty query */
+  GPtrArray            *action_entries;
+};
+
+G_DEFINE_TYPE (DeapCommandPalette, deap_command_palette, GTK_TYPE_POPOVER)
+
+
+/* --- Index --- */
+static void
+palette_entry_free (gpointer data)
+{
+  PaletteEntry *entry = data;
+
+  g_free (entry->key);
+  g_free (entry->title);
+  g_free (entry->subtitle);
+  g_free (entry->target);
+  g_clear_object (&entry->extension);
+  g_free (entry);
+}
+
+/* Takes @entry; returns it, or NULL if its key is taken */
+static PaletteEntry *
+insert_entry (DeapCommandPalette *self,
+              PaletteEntry       *entry)
+{
+  if (!deap_palette_index_insert (self->index, entry->key, entry)) {
+    deap_debug_msg ("Not indexing duplicate key %s", entry->key);
+    palette_entry_free (entry);
+    return NULL;
+  }
+
+  return entry;
+}
+
+static void
+remove_entry (DeapCommandPalette *self,
+              PaletteEntry       *entry)
+{
+  deap_palette_index_remove (self->index, entry->key);
+}
+
+static void
+add_action_cb (const gchar *detailed_name,
+               const gchar *label,
+               gpointer     user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  PaletteEntry *entry;
+
+  entry = g_new0 (PaletteEntry, 1);
+  entry->kind = PALETTE_ENTRY_ACTION;
+  entry->key = g_strdup (label);
+  entry->title = g_strdup (label);
+  entry->subtitle = g_strdup (_("org.gnome.Shell action"));
+  entry->target = g_strdup (detailed_name);
+
+  entry = insert_entry (self, entry);
+  if (entry != NULL)
+    g_ptr_array_add (self->action_entries, entry);
+}
+
+static PaletteEntry *
+add_extension (DeapCommandPalette *self,
+               DeapShellExtension *extension)
+{
+  const gchar *name = deap_shell_extension_get_name (extension);
+  const gchar *uuid = deap_shell_extension_get_uuid (extension);
+  const gchar *description = deap_shell_extension_get_description (extension);
+  PaletteEntry *entry;
+
+  if (uuid == NULL)
+    return NULL;
+
+  entry = g_new0 (PaletteEntry, 1);
+  entry->kind = PALETTE_ENTRY_EXTENSION;
+  entry->key = g_strjoin (" ", name ? name : "", uuid, description ? description : "", NULL);
+  entry->title = g_strdup (name ? name : uuid);
+  entry->subtitle = g_strdup (uuid);
+  entry->extension = g_object_ref (extension);
+
+  return insert_entry (self, entry);
+}
+
+/*
+ * on_extensions_items_changed_cb
+ *
+ * Mirrors the change into extension_entries. An update in place (a
+ * state change) leaves the model alone, and the indexed fields with it.
+ */
+static void
+on_extensions_items_changed_cb (GListModel *model,
+                                guint       position,
+                                guint       removed,
+                                guint       added,
+                                gpointer    user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  guint i;
+
+  for (i = 0; i < removed; i++) {
+    PaletteEntry *entry = g_ptr_array_index (self->extension_entries, position + i);
+
+    if (entry != NULL)
+      remove_entry (self, entry);
+  }
+
+  if (removed > 0)
+    g_ptr_array_remove_range (self->extension_entries, position, removed);
+
+  if (added == 0)
+    return;
+
+  deap_palette_index_begin_bulk_insert (self->index);
+
+  for (i = 0; i < added; i++) {
+    g_autoptr(DeapShellExtension) extension = g_list_model_get_item (model, position + i);
+
+    g_ptr_array_insert (self->extension_entries, position + i, add_extension (self, extension));
+  }
+
+  deap_palette_index_end_bulk_insert (self->index);
+}
+
+static gchar *
+session_key (const gchar *session_id,
+             const gchar *user_name,
+             const gchar *seat_id)
+{
+  return g_strjoin (" ", session_id, user_name ? user_name : "", seat_id ? seat_id : "", NULL);
+}
+
+/* Without a user name, the UID is only a placeholder, see DeapLogin1 */
+static gchar *
+session_subtitle (guint        user_id,
+                  const gchar *user_name,
+                  const gchar *seat_id)
+{
+  if (user_name == NULL)
+    return g_strdup ("…");
+
+  return g_strdup_printf ("%s (%u)%s%s",
+                          user_name ? user_name : "", user_id,
+                          seat_id ? " · " : "", seat_id ? seat_id : "");
+}
+
+static void
+on_session_added_cb (DeapLogin1  *login1,
+                     const gchar *session_id,
+                     guint        user_id,
+                     const gchar *user_name,
+                     const gchar *seat_id,
+                     gpointer     user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  PaletteEntry *entry;
+
+  entry = g_new0 (PaletteEntry, 1);
+  entry->kind = PALETTE_ENTRY_SESSION;
+  entry->key = session_key (session_id, user_name, seat_id);
+  entry->title = g_strdup_printf (_("Session %s"), session_id);
+  entry->subtitle = session_subtitle (user_id, user_name, seat_id);
+  entry->target = g_strdup (session_id);
+
+  entry = insert_entry (self, entry);
+  if (entry != NULL)
+    g_hash_table_insert (self->session_entries, g_strdup (session_id), entry);
+}
+
+static void
+on_session_removed_cb (DeapLogin1  *login1,
+                       const gchar *session_id,
+                       guint        user_id,
+                       const gchar *user_name,
+                       const gchar *seat_id,
+                       gpointer     user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  PaletteEntry *entry;
+
+  entry = g_hash_table_lookup (self->session_entries, session_id);
+  if (entry == NULL)
+    return;
+
+  g_hash_table_remove (self->session_entries, session_id);
+  remove_entry (self, entry);
+}
+
+/*
+ * on_session_changed_cb
+ *
+ * The key holds the user and seat names, so a change of either is
+ * indexed anew; anything else (the UID) only patches the subtitle.
+ */
+static void
+on_session_changed_cb (DeapLogin1  *login1,
+                       const gchar *session_id,
+                       guint        user_id,
+                       const gchar *user_name,
+                       const gchar *seat_id,
+                       gpointer     user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  g_autofree gchar *key = NULL;
+  PaletteEntry *entry;
+
+  entry = g_hash_table_lookup (self->session_entries, session_id);
+  key = session_key (session_id, user_name, seat_id);
+
+  if (entry != NULL && g_str_equal (entry->key, key)) {
+    g_free (entry->subtitle);
+    entry->subtitle = session_subtitle (user_id, user_name, seat_id);
+    return;
+  }
+
+  on_session_removed_cb (login1, session_id, user_id, user_name, seat_id, user_data);
+  on_session_added_cb (login1, session_id, user_id, user_name, seat_id, user_data);
+}
+
+static void
+build_index (DeapCommandPalette *self)
+{
+  DeapGnomeShell *shell = DEAP_GNOME_SHELL (deap_gnome_shell_get_instance ());
+  DeapLogin1 *login1 = DEAP_LOGIN1 (deap_login1_get_instance ());
+  GListModel *extensions;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_palette_index_begin_bulk_insert (self->index);
+  deap_shell_actions_foreach (add_action_cb, self);
+  deap_login1_foreach_session (login1, on_session_added_cb, self);
+  deap_palette_index_end_bulk_insert (self->index);
+
+  extensions = deap_gnome_shell_get_extensions (shell);
+  on_extensions_items_changed_cb (extensions, 0, 0, g_list_model_get_n_items (extensions), self);
+
+  g_signal_connect_object (extensions, "items-changed",
+                           G_CALLBACK (on_extensions_items_changed_cb), self, 0);
+  g_signal_connect_object (login1, "session-added",
+                           G_CALLBACK (on_session_added_cb), self, 0);
+  g_signal_connect_object (login1, "session-changed",
+                           G_CALLBACK (on_session_changed_cb), self, 0);
+  g_signal_connect_object (login1, "session-removed",
+                           G_CALLBACK (on_session_removed_cb), self, 0);
+}
+/* --- End of Index --- */
+
+
+/* --- Results --- */
+static GtkWidget *
+create_result_row (const PaletteEntry *entry)
+{
+  GtkWidget *row;
+  GtkWidget *vbox;
+  GtkWidget *title;
+  GtkWidget *subtitle;
+
+  row = gtk_list_box_row_new ();
+  g_object_set_data_full (G_OBJECT (row), "palette-key", g_strdup (entry->key), g_free);
+
+  vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 2);
+  g_object_set (vbox, "margin", 4, NULL);
+
+  title = gtk_label_new (entry->title);
+  gtk_label_set_xalign (GTK_LABEL (title), 0);
+  gtk_label_set_ellipsize (GTK_LABEL (title), PANGO_ELLIPSIZE_END);
+  gtk_box_pack_start (GTK_BOX (vbox), title, FALSE, FALSE, 0);
+
+  subtitle = gtk_label_new (entry->subtitle);
+  gtk_label_set_xalign (GTK_LABEL (subtitle), 0);
+  gtk_label_set_ellipsize (GTK_LABEL (subtitle), PANGO_ELLIPSIZE_END);
+  gtk_style_context_add_class (gtk_widget_get_style_context (subtitle), "dim-label");
+  gtk_box_pack_start (GTK_BOX (vbox), subtitle, FALSE, FALSE, 0);
+
+  gtk_container_add (GTK_CONTAINER (row), vbox);
+  gtk_widget_show_all (row);
+
+  return row;
+}
+
+static void
+clear_results (DeapCommandPalette *self)
+{
+  GList *children;
+  GList *l;
+
+  children = gtk_container_get_children (GTK_CONTAINER (self->result_list));
+  for (l = children; l != NULL; l = l->next)
+    gtk_widget_destroy (l->data);
+  g_list_free (children);
+}
+
+static void
+update_results (DeapCommandPalette *self)
+{
+  const gchar *query;
+  g_autoptr(GPtrArray) matches = NULL;
+  gint64 begin;
+  guint i;
+
+  clear_results (self);
+
+  query = gtk_entry_get_text (GTK_ENTRY (self->search_entry));
+
+  if (query == NULL || *query == '\0') {
+    for (i = 0; i < self->action_entries->len; i++)
+      gtk_container_add (GTK_CONTAINER (self->result_list),
+                         create_result_row (g_ptr_array_index (self->action_entries, i)));
+    return;
+  }
+
+  begin = g_get_monotonic_time ();
+  matches = deap_palette_index_match (self->index, query, MAX_RESULTS);
+  deap_metrics_histogram_record ("palette.query", g_get_monotonic_time () - begin);
+
+  for (i = 0; i < matches->len; i++)
+    gtk_container_add (GTK_CONTAINER (self->result_list),
+                       create_result_row (g_ptr_array_index (matches, i)));
+
+  if (matches->len > 0)
+    gtk_list_box_select_row (GTK_LIST_BOX (self->result_list),
+                             gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->result_list), 0));
+}
+
+static void
+activate_entry (DeapCommandPalette *self,
+                const PaletteEntry *entry)
+{
+  GtkWidget *window = gtk_widget_get_toplevel (GTK_WIDGET (self));
+
+  switch (entry->kind) {
+    case PALETTE_ENTRY_ACTION:
+      if (g_str_has_prefix (entry->target, "app."))
+        g_action_group_activate_action (G_ACTION_GROUP (g_application_get_default ()),
+                                        entry->target + strlen ("app."),
+                                        NULL);
+      break;
+
+    case PALETTE_ENTRY_EXTENSION:
+      if (DEAP_IS_WINDOW (window))
+        deap_window_show_page (DEAP_WINDOW (window), "gnome-shell");
+      deap_gnome_shell_select_extension (DEAP_GNOME_SHELL (deap_gnome_shell_get_instance ()),
+                                         entry->extension);
+      break;
+
+    case PALETTE_ENTRY_SESSION:
+      if (DEAP_IS_WINDOW (window))
+        deap_window_show_page (DEAP_WINDOW (window), "freedesktop-login1");
+      deap_login1_select_session (DEAP_LOGIN1 (deap_login1_get_instance ()), entry->target);
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+/* --- End of Results --- */
+
+
+/* --- Callbacks --- */
+static void
+on_search_changed_cb (GtkSearchEntry *entry,
+                      gpointer        user_data)
+{
+  update_results (DEAP_COMMAND_PALETTE (user_data));
+}
+
+static void
+on_result_row_activated_cb (GtkListBox    *box,
+                            GtkListBoxRow *row,
+                            gpointer       user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  const PaletteEntry *entry;
+  const gchar *key;
+
+  /* Looked up again: the entry may have gone since the row was built */
+  key = g_object_get_data (G_OBJECT (row), "palette-key");
+  entry = deap_palette_index_lookup (self->index, key);
+
+  gtk_popover_popdown (GTK_POPOVER (self));
+
+  if (entry != NULL)
+    activate_entry (self, entry);
+}
+
+static void
+on_search_activate_cb (GtkEntry *entry,
+                       gpointer  user_data)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (user_data);
+  GtkListBoxRow *row;
+
+  row = gtk_list_box_get_selected_row (GTK_LIST_BOX (self->result_list));
+  if (row != NULL)
+    on_result_row_activated_cb (GTK_LIST_BOX (self->result_list), row, self);
+}
+
+static void
+on_stop_search_cb (GtkSearchEntry *entry,
+                   gpointer        user_data)
+{
+  gtk_popover_popdown (GTK_POPOVER (user_data));
+}
+/* --- End of Callbacks --- */
+
+
+/* --- GObject --- */
+/* Every popup starts from an empty query */
+static void
+deap_command_palette_map (GtkWidget *widget)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (widget);
+
+  GTK_WIDGET_CLASS (deap_command_palette_parent_class)->map (widget);
+
+  gtk_entry_set_text (GTK_ENTRY (self->search_entry), "");
+  update_results (self);
+  gtk_widget_grab_focus (self->search_entry);
+}
+
+static void
+deap_command_palette_finalize (GObject *object)
+{
+  DeapCommandPalette *self = DEAP_COMMAND_PALETTE (object);
+
+  g_clear_pointer (&self->action_entries, g_ptr_array_unref);
+  g_clear_pointer (&self->session_entries, g_hash_table_unref);
+  g_clear_pointer (&self->extension_entries, g_ptr_array_unref);
+  g_clear_pointer (&self->index, deap_palette_index_free);
+
+  G_OBJECT_CLASS (deap_command_palette_parent_class)->finalize (object);
+}
+
+static void
+deap_command_palette_class_init (DeapCommandPaletteClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->finalize = deap_command_palette_finalize;
+
+  widget_class->map = deap_command_palette_map;
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/com/github/memnoth/Deap/deap-command-palette.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, DeapCommandPalette, search_entry);
+  gtk_widget_class_bind_template_child (widget_class, DeapCommandPalette, result_list);
+  gtk_widget_class_bind_template_callback (widget_class, on_search_changed_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_search_activate_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_stop_search_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_result_row_activated_cb);
+}
+
+static void
+deap_command_palette_init (DeapCommandPalette *self)
+{
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->index = deap_palette_index_new (palette_entry_free);
+  self->extension_entries = g_ptr_array_new ();
+  self->session_entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->action_entries = g_ptr_array_new ();
+
+  build_index (self);
+}
+
+GtkWidget *
+deap_command_palette_new (GtkWidget *relative_to)
+{
+  return GTK_WIDGET (g_object_new (DEAP_TYPE_COMMAND_PALETTE,
+                                   "relative-to", relative_to,
+                                   NULL));
+}
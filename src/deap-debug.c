@@ -0,0 +1,230 @@
+/* deap-debug.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "deap-debug.h"
+
+#include <string.h>
+
+#define DEAP_LOG_LEVELS_UP_TO(_level)  (((_level) << 1) - G_LOG_LEVEL_ERROR)
+
+#define DEAP_LOG_LEVELS_NONE     0
+#define DEAP_LOG_LEVELS_DEFAULT  DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_DEBUG)
+
+typedef struct
+{
+  const gchar *name;
+  gint         levels;
+} LevelName;
+
+static const LevelName level_names[] =
+{
+  { "none",     DEAP_LOG_LEVELS_NONE },
+  { "error",    DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_ERROR) },
+  { "critical", DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_CRITICAL) },
+  { "warning",  DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_WARNING) },
+  { "message",  DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_MESSAGE) },
+  { "info",     DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_INFO) },
+  { "debug",    DEAP_LOG_LEVELS_UP_TO (G_LOG_LEVEL_DEBUG) },
+  { "trace",    DEAP_LOG_LEVELS_UP_TO (DEAP_LOG_LEVEL_TRACE) },
+};
+
+/* Applied before any other source */
+static const gchar *builtin_spec = "GdkPixbuf=none";
+
+static GRWLock categories_lock;
+static GHashTable *categories = NULL;     /* domain -> DeapLogCategory */
+static GHashTable *configured = NULL;     /* domain -> levels from specs */
+static gint default_levels = DEAP_LOG_LEVELS_DEFAULT;
+static gchar *source_specs[DEAP_LOG_N_SOURCES] = { NULL };
+
+
+static gboolean
+parse_level_name (const gchar *name,
+                  gint        *levels)
+{
+  gsize i;
+
+  for (i = 0; i < G_N_ELEMENTS (level_names); i++) {
+    if (g_ascii_strcasecmp (level_names[i].name, name) == 0) {
+      *levels = level_names[i].levels;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Must be called with the write lock held */
+static void
+apply_spec (const gchar *spec)
+{
+  g_auto(GStrv) entries = NULL;
+  gsize i;
+
+  if (spec == NULL)
+    return;
+
+  entries = g_strsplit (spec, ",", -1);
+
+  for (i = 0; entries[i]; i++) {
+    g_autofree gchar *domain = NULL;
+    const gchar *level_name;
+    gchar *entry;
+    gchar *sep;
+    gint levels;
+
+    entry = g_strstrip (entries[i]);
+    if (*entry == '\0')
+      continue;
+
+    /* A bare level applies to every domain */
+    sep = strchr (entry, '=');
+    if (sep == NULL) {
+      domain = g_strdup ("*");
+      level_name = entry;
+    } else {
+      domain = g_strstrip (g_strndup (entry, sep - entry));
+      level_name = g_strstrip (sep + 1);
+    }
+
+    if (!parse_level_name (level_name, &levels)) {
+      g_printerr ("Unknown log level \"%s\" for %s\n", level_name, domain);
+      continue;
+    }
+
+    if (g_strcmp0 (domain, "*") == 0)
+      default_levels = levels;
+    else
+      g_hash_table_insert (configured, g_steal_pointer (&domain), GINT_TO_POINTER (levels));
+  }
+}
+
+/* Must be called with the write lock held */
+static gint
+get_configured_levels (const gchar *domain)
+{
+  gpointer levels;
+
+  if (g_hash_table_lookup_extended (configured, domain, NULL, &levels))
+    return GPOINTER_TO_INT (levels);
+
+  return default_levels;
+}
+
+/* Must be called with the write lock held */
+static void
+rebuild_levels (void)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gsize i;
+
+  /* Rebuild from scratch, later sources override earlier ones */
+  g_hash_table_remove_all (configured);
+  default_levels = DEAP_LOG_LEVELS_DEFAULT;
+  apply_spec (builtin_spec);
+
+  for (i = 0; i < DEAP_LOG_N_SOURCES; i++)
+    apply_spec (source_specs[i]);
+
+  g_hash_table_iter_init (&iter, categories);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    DeapLogCategory *category = value;
+
+    g_atomic_int_set (&category->levels, get_configured_levels (category->domain));
+  }
+}
+
+static void
+ensure_tables (void)
+{
+  static gsize initialized = FALSE;
+
+  if (g_once_init_enter (&initialized)) {
+    categories = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+    configured = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    source_specs[DEAP_LOG_SOURCE_ENVIRONMENT] = g_strdup (g_getenv ("DEAP_LOG_LEVELS"));
+    rebuild_levels ();
+
+    g_once_init_leave (&initialized, TRUE);
+  }
+}
+
+DeapLogCategory *
+deap_log_category_lookup (const gchar *domain)
+{
+  DeapLogCategory *category;
+
+  ensure_tables ();
+
+  if (domain == NULL)
+    domain = "";
+
+  g_rw_lock_reader_lock (&categories_lock);
+  category = g_hash_table_lookup (categories, domain);
+  g_rw_lock_reader_unlock (&categories_lock);
+
+  if (G_LIKELY (category != NULL))
+    return category;
+
+  g_rw_lock_writer_lock (&categories_lock);
+
+  category = g_hash_table_lookup (categories, domain);
+  if (category == NULL) {
+    category = g_new0 (DeapLogCategory, 1);
+    category->domain = g_intern_string (domain);
+    category->levels = get_configured_levels (domain);
+
+    g_hash_table_insert (categories, (gpointer) category->domain, category);
+  }
+
+  g_rw_lock_writer_unlock (&categories_lock);
+
+  return category;
+}
+
+gboolean
+deap_log_domain_is_enabled (const gchar    *domain,
+                            GLogLevelFlags  log_level)
+{
+  DeapLogCategory *category;
+
+  category = deap_log_category_lookup (domain);
+
+  return (g_atomic_int_get (&category->levels) & log_level) != 0;
+}
+
+void
+deap_log_set_levels (DeapLogSource  source,
+                     const gchar   *spec)
+{
+  g_return_if_fail (source < DEAP_LOG_N_SOURCES);
+
+  ensure_tables ();
+
+  g_rw_lock_writer_lock (&categories_lock);
+
+  g_free (source_specs[source]);
+  source_specs[source] = g_strdup (spec);
+  rebuild_levels ();
+
+  g_rw_lock_writer_unlock (&categories_lock);
+}
@@ -24,6 +24,8 @@
 
 #include <glib.h>
 
+#include "deap-trace.h"
+
 G_BEGIN_DECLS
 
 #ifndef DEAP_ENABLE_TRACE
@@ -42,13 +44,69 @@ G_BEGIN_DECLS
 # define GTD_LOG_LEVEL_TRACE  DEAP_LOG_LEVEL_TRACE
 #endif
 
-#ifdef DEAP_ENABLE_TRACE
+/*
+ * Log categories
+ *
+ * Every G_LOG_DOMAIN owns a category holding the mask of enabled log
+ * levels. The macros below check it inline, before any argument is
+ * formatted. Levels are set with "DOMAIN=LEVEL,*=LEVEL" specs coming
+ * from the log-levels GSettings key, the DEAP_LOG_LEVELS environment
+ * variable and the --log-levels option, in increasing priority.
+ */
+typedef struct
+{
+  const gchar   *domain;
+  volatile gint  levels;
+} DeapLogCategory;
+
+typedef enum
+{
+  DEAP_LOG_SOURCE_DEBUG_OPTION,
+  DEAP_LOG_SOURCE_SETTINGS,
+  DEAP_LOG_SOURCE_ENVIRONMENT,
+  DEAP_LOG_SOURCE_COMMAND_LINE,
+  DEAP_LOG_N_SOURCES
+} DeapLogSource;
+
+DeapLogCategory *     deap_log_category_lookup      (const gchar    *domain);
+
+gboolean              deap_log_domain_is_enabled    (const gchar    *domain,
+                                                     GLogLevelFlags  log_level);
+
+void                  deap_log_set_levels           (DeapLogSource   source,
+                                                     const gchar    *spec);
+
+static inline gboolean
+deap_log_is_enabled (GLogLevelFlags log_level)
+{
+  /* One cached category per translation unit, i.e. per G_LOG_DOMAIN */
+  static DeapLogCategory *category = NULL;
+  DeapLogCategory *c;
+
+  c = g_atomic_pointer_get (&category);
+  if (G_UNLIKELY (c == NULL)) {
+    c = deap_log_category_lookup (G_LOG_DOMAIN);
+    g_atomic_pointer_set (&category, c);
+  }
+
+  return (g_atomic_int_get (&c->levels) & log_level) != 0;
+}
+
+#define deap_log_level(level, fmt, ...) \
+  G_STMT_START { \
+    if (deap_log_is_enabled (level)) \
+      g_log (G_LOG_DOMAIN, level, fmt, ##__VA_ARGS__); \
+  } G_STMT_END
 
 
+#ifdef DEAP_ENABLE_TRACE
+
 #define deap_log(fmt, ...) \
-  g_log(G_LOG_DOMAIN, DEAP_LOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+  deap_log_level (DEAP_LOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
 
+/* Also opens a span which lasts until the function returns */
 #define DEAP_TRACE_ENTRY \
+  DEAP_TRACE_SCOPE (G_STRFUNC); \
   deap_log("ENTRY: %s(): %d", G_STRFUNC, __LINE__)
 
 #define DEAP_TRACE_EXIT \
@@ -58,22 +116,29 @@ G_BEGIN_DECLS
 #define deap_trace_msg(fmt, ...) \
   deap_log("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
+#else
+
+/* Trace sites are compiled out, arguments are not even evaluated */
+#define deap_log(fmt, ...)          G_STMT_START { } G_STMT_END
+#define DEAP_TRACE_ENTRY            G_STMT_START { } G_STMT_END
+#define DEAP_TRACE_EXIT             G_STMT_START { } G_STMT_END
+#define deap_trace_msg(fmt, ...)    G_STMT_START { } G_STMT_END
+
+#endif
+
 #define deap_info_msg(fmt, ...) \
-  g_info ("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
+  deap_log_level (G_LOG_LEVEL_INFO, "  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
 #define deap_debug_msg(fmt, ...) \
-  g_debug("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
+  deap_log_level (G_LOG_LEVEL_DEBUG, "  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
 #define deap_error_msg(fmt, ...) \
   g_error("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
 #define deap_warn_msg(fmt, ...) \
-  g_warning ("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
+  deap_log_level (G_LOG_LEVEL_WARNING, "  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
 #define deap_critical_msg(fmt, ...) \
-  g_critical("  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
-
-
-#endif
+  deap_log_level (G_LOG_LEVEL_CRITICAL, "  MSG: %s(): %d: " fmt, G_STRFUNC, __LINE__, ##__VA_ARGS__)
 
 G_END_DECLS
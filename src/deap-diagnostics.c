@@ -0,0 +1,226 @@
+/* deap-diagnostics.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#define G_LOG_DOMAIN "DeapDiagnostics"
+
+#include "deap-config.h"
+#include "deap-debug.h"
+#include "deap-diagnostics.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
+
+/*
+ * Shows the metrics registry, refreshed every REFRESH_INTERVAL_MSEC while
+ * the page is mapped. Rows are updated in place, so a refresh only
+ * appends the metrics that appeared since the last one.
+ */
+
+#define REFRESH_INTERVAL_MSEC   1000
+
+enum {
+  COLUMN_NAME,
+  COLUMN_VALUE,
+  N_COLUMNS
+};
+
+struct _DeapDiagnostics
+{
+  GtkBox        parent_instance;
+
+  /* Widgets */
+  GtkWidget    *metric_view;
+  GtkListStore *metric_store;
+
+  /* Metric name -> GtkTreeIter in metric_store */
+  GHashTable   *rows;
+
+  guint         refresh_source_id;
+};
+
+G_DEFINE_TYPE (DeapDiagnostics, deap_diagnostics, GTK_TYPE_BOX)
+
+
+/* --- Metrics --- */
+static gchar *
+format_snapshot (const DeapMetricSnapshot *snapshot)
+{
+  switch (snapshot->type) {
+    case DEAP_METRIC_COUNTER:
+      return g_strdup_printf ("%" G_GINT64_FORMAT, snapshot->value);
+
+    case DEAP_METRIC_GAUGE:
+      if (g_str_has_suffix (snapshot->name, "_bytes"))
+        return g_format_size ((guint64) snapshot->value);
+      return g_strdup_printf ("%" G_GINT64_FORMAT, snapshot->value);
+
+    case DEAP_METRIC_HISTOGRAM:
+      return g_strdup_printf ("n=%" G_GUINT64_FORMAT "  p50=%" G_GINT64_FORMAT " us  "
+                              "p99=%" G_GINT64_FORMAT " us  max=%" G_GINT64_FORMAT " us",
+                              snapshot->count, snapshot->p50, snapshot->p99, snapshot->max);
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+static void
+update_metric_row_cb (const DeapMetricSnapshot *snapshot,
+                      gpointer                  user_data)
+{
+  DeapDiagnostics *self = DEAP_DIAGNOSTICS (user_data);
+  g_autofree gchar *value = NULL;
+  GtkTreeIter *iter;
+
+  value = format_snapshot (snapshot);
+
+  iter = g_hash_table_lookup (self->rows, snapshot->name);
+  if (iter == NULL) {
+    iter = g_new0 (GtkTreeIter, 1);
+    gtk_list_store_append (self->metric_store, iter);
+    gtk_list_store_set (self->metric_store, iter, COLUMN_NAME, snapshot->name, -1);
+    g_hash_table_insert (self->rows, g_strdup (snapshot->name), iter);
+  }
+
+  /* GtkListStore iters stay valid as long as the row exists */
+  gtk_list_store_set (self->metric_store, iter, COLUMN_VALUE, value, -1);
+}
+
+static void
+refresh_metrics (DeapDiagnostics *self)
+{
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_metrics_sample_process ();
+  deap_metrics_foreach (update_metric_row_cb, self);
+}
+
+static gboolean
+refresh_metrics_cb (gpointer user_data)
+{
+  refresh_metrics (DEAP_DIAGNOSTICS (user_data));
+
+  return G_SOURCE_CONTINUE;
+}
+/* --- End of Metrics --- */
+
+
+/* --- GtkWidget --- */
+static void
+deap_diagnostics_map (GtkWidget *widget)
+{
+  DeapDiagnostics *self = DEAP_DIAGNOSTICS (widget);
+
+  GTK_WIDGET_CLASS (deap_diagnostics_parent_class)->map (widget);
+
+  refresh_metrics (self);
+
+  if (self->refresh_source_id == 0)
+    self->refresh_source_id = g_timeout_add (REFRESH_INTERVAL_MSEC, refresh_metrics_cb, self);
+}
+
+static void
+deap_diagnostics_unmap (GtkWidget *widget)
+{
+  DeapDiagnostics *self = DEAP_DIAGNOSTICS (widget);
+
+  if (self->refresh_source_id) {
+    g_source_remove (self->refresh_source_id);
+    self->refresh_source_id = 0;
+  }
+
+  GTK_WIDGET_CLASS (deap_diagnostics_parent_class)->unmap (widget);
+}
+/* --- End of GtkWidget --- */
+
+
+/* --- GObject --- */
+static void
+deap_diagnostics_dispose (GObject *object)
+{
+  DeapDiagnostics *self = DEAP_DIAGNOSTICS (object);
+
+  if (self->refresh_source_id) {
+    g_source_remove (self->refresh_source_id);
+    self->refresh_source_id = 0;
+  }
+
+  G_OBJECT_CLASS (deap_diagnostics_parent_class)->dispose (object);
+}
+
+static void
+deap_diagnostics_finalize (GObject *object)
+{
+  DeapDiagnostics *self = DEAP_DIAGNOSTICS (object);
+
+  g_clear_pointer (&self->rows, g_hash_table_unref);
+
+  G_OBJECT_CLASS (deap_diagnostics_parent_class)->finalize (object);
+}
+
+static void
+deap_diagnostics_class_init (DeapDiagnosticsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+  object_class->dispose = deap_diagnostics_dispose;
+  object_class->finalize = deap_diagnostics_finalize;
+
+  widget_class->map = deap_diagnostics_map;
+  widget_class->unmap = deap_diagnostics_unmap;
+
+  gtk_widget_class_set_template_from_resource (widget_class, "/com/github/memnoth/Deap/deap-diagnostics.ui");
+
+  gtk_widget_class_bind_template_child (widget_class, DeapDiagnostics, metric_view);
+  gtk_widget_class_bind_template_child (widget_class, DeapDiagnostics, metric_store);
+}
+
+static void
+deap_diagnostics_init (DeapDiagnostics *self)
+{
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  gtk_widget_init_template (GTK_WIDGET (self));
+
+  self->rows = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* Nothing to fetch, the registry is local */
+  deap_profile_page_populated ("diagnostics");
+}
+
+static GtkWidget *
+deap_diagnostics_new (void)
+{
+  return GTK_WIDGET (g_object_new (DEAP_TYPE_DIAGNOSTICS, NULL));
+}
+
+GtkWidget *
+deap_diagnostics_get_instance (void)
+{
+  static GtkWidget * instance = NULL;
+
+  if (instance == NULL) {
+    instance = deap_diagnostics_new ();
+    g_object_add_weak_pointer (G_OBJECT (instance), (gpointer) &instance);
+  }
+
+  return instance;
+}
@@ -0,0 +1,177 @@
+/* deap-extension-cache.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapExtensionCache"
+
+#include "deap-config.h"
+#include "deap-debug.h"
+#include "deap-extension-cache.h"
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+/*
+ * The last ListExtensions reply, kept in $XDG_CACHE_HOME/deap as a
+ * serialized (usa{sa{sv}}): format, ShellVersion and the reply itself.
+ *
+ * It is mapped, not read, and the a{sa{sv}} handed out points into the
+ * mapping, so the DeapShellExtension records built from it copy nothing.
+ * The file is only ever replaced by a rename, which leaves mappings of
+ * the previous one intact. It is in host byte order, since it never
+ * leaves the machine.
+ */
+
+#define CACHE_FORMAT_VERSION  1
+#define CACHE_TYPE            "(usa{sa{sv}})"
+
+typedef struct
+{
+  gchar    *shell_version;
+  GVariant *extensions;
+} SaveData;
+
+
+static gchar *
+get_cache_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "deap", "extensions.gvariant", NULL);
+}
+
+/*
+ * deap_extension_cache_load
+ *
+ * @shell_version: (out) (transfer full): the ShellVersion the listing
+ * was taken from
+ *
+ * Returns: (transfer full) (nullable): the cached a{sa{sv}}, backed by
+ * the mapped file
+ */
+GVariant *
+deap_extension_cache_load (gchar **shell_version)
+{
+  g_autofree gchar *path = NULL;
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GBytes) bytes = NULL;
+  g_autoptr(GVariant) cache = NULL;
+  GMappedFile *mapped;
+  GVariant *extensions = NULL;
+  const gchar *version;
+  guint32 format;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  g_return_val_if_fail (shell_version != NULL, NULL);
+
+  path = get_cache_path ();
+
+  mapped = g_mapped_file_new (path, FALSE, &error);
+  if (mapped == NULL) {
+    if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      deap_warn_msg ("Could not map %s: %s", path, error->message);
+    return NULL;
+  }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  g_mapped_file_unref (mapped);
+
+  /* Untrusted: a truncated or foreign file reads as default values */
+  cache = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+
+  g_variant_get (cache, "(u&s@a{sa{sv}})", &format, &version, &extensions);
+
+  if (format != CACHE_FORMAT_VERSION) {
+    deap_debug_msg ("Ignoring %s of format %u", path, format);
+    g_variant_unref (extensions);
+    return NULL;
+  }
+
+  *shell_version = g_strdup (version);
+
+  return extensions;
+}
+
+static void
+save_data_free (gpointer data)
+{
+  SaveData *save = data;
+
+  g_free (save->shell_version);
+  g_variant_unref (save->extensions);
+  g_free (save);
+}
+
+static void
+save_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+  SaveData *save = task_data;
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *dir = NULL;
+  g_autoptr(GVariant) cache = NULL;
+  g_autoptr(GError) error = NULL;
+
+  path = get_cache_path ();
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0700) != 0) {
+    deap_warn_msg ("Could not create %s", dir);
+    return;
+  }
+
+  cache = g_variant_ref_sink (g_variant_new ("(us@a{sa{sv}})",
+                                             CACHE_FORMAT_VERSION,
+                                             save->shell_version,
+                                             save->extensions));
+
+  /* Written to a temporary file and renamed over the old one */
+  if (!g_file_set_contents (path, g_variant_get_data (cache), g_variant_get_size (cache), &error))
+    deap_warn_msg ("Could not write %s: %s", path, error->message);
+  else
+    deap_trace_msg ("Cached %" G_GSIZE_FORMAT " extensions, %" G_GSIZE_FORMAT " bytes",
+                    g_variant_n_children (save->extensions), g_variant_get_size (cache));
+}
+
+/*
+ * deap_extension_cache_save
+ *
+ * Replaces the cache with @extensions, an a{sa{sv}}, from a worker
+ * thread.
+ */
+void
+deap_extension_cache_save (const gchar *shell_version,
+                           GVariant    *extensions)
+{
+  g_autoptr(GTask) task = NULL;
+  SaveData *save;
+
+  g_return_if_fail (shell_version != NULL);
+  g_return_if_fail (extensions != NULL);
+  g_return_if_fail (g_variant_is_of_type (extensions, G_VARIANT_TYPE ("a{sa{sv}}")));
+
+  save = g_new0 (SaveData, 1);
+  save->shell_version = g_strdup (shell_version);
+  save->extensions = g_variant_ref (extensions);
+
+  task = g_task_new (NULL, NULL, NULL, NULL);
+  g_task_set_source_tag (task, deap_extension_cache_save);
+  g_task_set_task_data (task, save, save_data_free);
+  g_task_run_in_thread (task, save_thread);
+}
@@ -21,22 +21,32 @@
 #define G_LOG_DOMAIN "DeapGnomeShell"
 
 #include "deap-config.h"
+#include "deap-bus-manager.h"
+#include "deap-call.h"
+#include "deap-dbus-shell.h"
+#include "deap-dbus-shell-extensions.h"
 #include "deap-debug.h"
+#include "deap-extension-cache.h"
 #include "deap-gnome-shell.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
+#include "deap-shell-extension.h"
 
 #include <gio/gio.h>
+#include <string.h>
 
 struct _DeapGnomeShell
 {
   GtkBox        parent_instance;
 
   /* org.gnome.Shell */
-  GDBusProxy    *shell;
+  DeapDBusShell *shell;
   GCancellable  *cancellable;
 
   /* org.gnome.Shell.Extensions */
-  GDBusProxy    *shell_extension;
+  DeapDBusShellExtensions *shell_extension;
   GCancellable  *extension_cancellable;
+  guint          extension_state_changed_id;
 
   /* Widgets */
   GtkWidget     *show_applications;
@@ -47,129 +57,478 @@ struct _DeapGnomeShell
   GActionGroup  *action_group;
 
   gchar         *shell_version;
-  GPtrArray     *shell_extension_infos;
-};
 
-typedef struct
-{
-  gchar *name;
-  gchar *description;
-  gchar *url;
-  gchar *uuid;
-} ShellExtensionInfo;
+  /*
+   * DeapShellExtension items, bound to extension_list_box. Records only
+   * ever join at the end, each with the next ordinal, so the model (and
+   * pending_extensions behind it) is sorted by ordinal and a record is
+   * found by bisection. One removed while pending is skipped when its
+   * turn comes, see is_listed().
+   */
+  GListStore    *extensions;
+  GHashTable    *extensions_by_uuid;
+  GPtrArray     *pending_extensions;
+  guint          pending_position;
+  guint          next_ordinal;
+  guint          populate_source_id;
+
+  /* The previous run's listing, see deap-extension-cache.c */
+  GVariant      *cached_extensions;
+  gchar         *cached_shell_version;
+  gboolean       showing_cached;
+  GVariant      *unsaved_extensions;
+
+  /* Trace flows of in-flight D-Bus requests */
+  guint          shell_flow;
+  guint          extension_flow;
+  guint          list_extensions_flow;
+};
 
 G_DEFINE_TYPE (DeapGnomeShell, deap_gnome_shell, GTK_TYPE_BOX)
 
-#define G_PTR_ARRAY_GET_LENGTH(_arrptr)   ((_arrptr)->len)
-#define SHELL_EXTENSION_INFO(_val)        ((ShellExtensionInfo*)_val)
+/*
+ * Rows are created synchronously by GtkListBox for every item added to
+ * the bound model, so items are moved from pending_extensions into the
+ * model in small batches from an idle, never spending more than this
+ * per main loop iteration.
+ */
+#define POPULATE_BUDGET_USEC      (4 * 1000)
+#define POPULATE_BATCH_SIZE       8
+
+G_DEFINE_QUARK (deap-gnome-shell-ordinal, extension_ordinal)
 
 
 /* --- Shell Extension Proxy --- */
-static gpointer
-shell_extension_info_new (GVariant *value   /* {sv} type */)
+static gboolean
+state_to_label (GBinding     *binding,
+                const GValue *from_value,
+                GValue       *to_value,
+                gpointer      user_data)
+{
+  g_value_set_static_string (to_value,
+                             deap_shell_extension_state_to_string (g_value_get_int (from_value)));
+
+  return TRUE;
+}
+
+static GtkWidget *
+create_extension_list_row (gpointer item,
+                           gpointer user_data)
 {
-  ShellExtensionInfo *info;
-  gchar *name;
-  gchar *description;
-  gchar *url;
-  gchar *uuid;
+  DeapShellExtension *extension = DEAP_SHELL_EXTENSION (item);
+  GtkWidget *row;
+  GtkWidget *hbox;
+  GtkWidget *name;
+  GtkWidget *state;
+  gint64 begin;
+
+  begin = g_get_monotonic_time ();
+
+  row = gtk_list_box_row_new ();
 
-  info = g_new0 (ShellExtensionInfo, 1);
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
 
-  g_variant_lookup (value, "name", "s", &name);
-  g_variant_lookup (value, "description", "s", &description);
-  g_variant_lookup (value, "url", "s", &url);
-  g_variant_lookup (value, "uuid", "s", &uuid);
+  /* Bound, so ExtensionStateChanged only touches the labels of its row */
+  name = gtk_label_new (NULL);
+  g_object_bind_property (extension, "name", name, "label", G_BINDING_SYNC_CREATE);
+  gtk_box_pack_start (GTK_BOX (hbox), name, TRUE, FALSE, 0);
 
-  info->name = g_strdup (name);
-  info->description = g_strdup (description);
-  info->url = g_strdup (url);
-  info->uuid = g_strdup (uuid);
+  state = gtk_label_new (NULL);
+  gtk_style_context_add_class (gtk_widget_get_style_context (state), "dim-label");
+  g_object_bind_property_full (extension, "state", state, "label", G_BINDING_SYNC_CREATE,
+                               state_to_label, NULL, NULL, NULL);
+  gtk_box_pack_end (GTK_BOX (hbox), state, FALSE, FALSE, 0);
+
+  gtk_container_add (GTK_CONTAINER (row), hbox);
+  gtk_widget_show_all (row);
+
+  deap_metrics_histogram_record ("rows.extension.build", g_get_monotonic_time () - begin);
+
+  return row;
+}
 
-  return (gpointer) info;
+/* --- Extension Table --- */
+static guint
+get_ordinal (DeapShellExtension *extension)
+{
+  return GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (extension), extension_ordinal_quark ()));
 }
 
 static void
-shell_extension_info_free (gpointer user_data)
+set_next_ordinal (DeapGnomeShell     *self,
+                  DeapShellExtension *extension)
 {
-  ShellExtensionInfo *info = SHELL_EXTENSION_INFO (user_data);
+  g_object_set_qdata (G_OBJECT (extension), extension_ordinal_quark (),
+                      GUINT_TO_POINTER (++self->next_ordinal));
+}
 
-  g_free (info->name);
-  g_free (info->description);
-  g_free (info->url);
-  g_free (info->uuid);
-  g_free (info);
+/* Records without a UUID are never removed */
+static gboolean
+is_listed (DeapGnomeShell     *self,
+           DeapShellExtension *extension)
+{
+  const gchar *uuid = deap_shell_extension_get_uuid (extension);
+
+  return uuid == NULL || g_hash_table_lookup (self->extensions_by_uuid, uuid) == extension;
 }
 
-static GPtrArray *
-parse_from_serialized_dbus_data (GVariant *resource)
+/* O(log n) by bisection over the ordinals */
+static gboolean
+find_extension_position (DeapGnomeShell     *self,
+                         DeapShellExtension *extension,
+                         guint              *position)
 {
-  g_autoptr(GVariant) dict = NULL;
-  g_autoptr(GVariantIter) iter = NULL;
-  GPtrArray *ret = NULL;
-  GVariant *child = NULL;
-  gsize len;
+  GListModel *model = G_LIST_MODEL (self->extensions);
+  guint ordinal = get_ordinal (extension);
+  guint lo = 0;
+  guint hi;
+
+  hi = g_list_model_get_n_items (model);
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    g_autoptr(DeapShellExtension) item = g_list_model_get_item (model, mid);
+    guint item_ordinal = get_ordinal (item);
+
+    if (item_ordinal == ordinal) {
+      *position = mid;
+      return item == extension;
+    }
+
+    if (item_ordinal < ordinal)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-  g_return_val_if_fail (resource != NULL, NULL);
+  return FALSE;
+}
+/* --- End of Extension Table --- */
+
+static gboolean
+populate_extensions_cb (gpointer user_data)
+{
+  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  GPtrArray *pending = self->pending_extensions;
+  gint64 deadline;
+
+  deadline = g_get_monotonic_time () + POPULATE_BUDGET_USEC;
+
+  do {
+    gpointer batch[POPULATE_BATCH_SIZE];
+    guint n_additions = 0;
+
+    /* Skips the records removed while they waited */
+    while (n_additions < POPULATE_BATCH_SIZE && self->pending_position < pending->len) {
+      DeapShellExtension *extension = g_ptr_array_index (pending, self->pending_position++);
+
+      if (is_listed (self, extension))
+        batch[n_additions++] = extension;
+    }
 
-  /* type (a{sa{sv}}) */
-  g_variant_get (resource, "(@a{?*})", &dict);
-  len = g_variant_n_children (dict);
+    g_list_store_splice (self->extensions,
+                         g_list_model_get_n_items (G_LIST_MODEL (self->extensions)),
+                         0,
+                         batch,
+                         n_additions);
+  } while (self->pending_position < pending->len &&
+           g_get_monotonic_time () < deadline);
 
-  ret = g_ptr_array_new_full (len, shell_extension_info_free);
+  if (self->pending_position < pending->len)
+    return G_SOURCE_CONTINUE;
 
-  iter = g_variant_iter_new (dict);
-  while ((child = g_variant_iter_next_value (iter))) {
-    const gchar *key;
-    gpointer p = NULL;
-    GVariant *val = NULL;
+  deap_trace_msg ("%u extensions populated", pending->len);
 
-    g_variant_get (child, "{s@a{?*}}", &key, &val);
+  g_clear_pointer (&self->pending_extensions, g_ptr_array_unref);
+  self->pending_position = 0;
+  self->populate_source_id = 0;
 
-    p = shell_extension_info_new (val);
-    g_ptr_array_add (ret, p);
+  deap_profile_page_populated ("gnome-shell");
 
-    g_variant_unref (child);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * append_extension
+ *
+ * While the model is still being populated, the records behind
+ * pending_position come first: @extension queues up after them so the
+ * list keeps its order.
+ */
+static void
+append_extension (DeapGnomeShell     *self,
+                  DeapShellExtension *extension)
+{
+  set_next_ordinal (self, extension);
+
+  if (self->pending_extensions != NULL)
+    g_ptr_array_add (self->pending_extensions, g_object_ref (extension));
+  else
+    g_list_store_append (self->extensions, extension);
+}
+
+/*
+ * remove_extension
+ *
+ * To be followed by dropping @extension from extensions_by_uuid, which
+ * is all it takes if it is still pending.
+ */
+static void
+remove_extension (DeapGnomeShell     *self,
+                  DeapShellExtension *extension)
+{
+  guint position;
+
+  if (find_extension_position (self, extension, &position))
+    g_list_store_remove (self->extensions, position);
+}
+
+/*
+ * reconcile_extensions
+ *
+ * A re-sync after the Shell came back: known UUIDs are updated in place,
+ * new ones appended and missing ones removed, so the rows which are
+ * still valid survive.
+ */
+static void
+reconcile_extensions (DeapGnomeShell *self,
+                      GPtrArray      *extensions)
+{
+  g_autoptr(GHashTable) listed = NULL;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  guint i;
+
+  listed = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < extensions->len; i++) {
+    DeapShellExtension *extension = g_ptr_array_index (extensions, i);
+    const gchar *uuid = deap_shell_extension_get_uuid (extension);
+    DeapShellExtension *old;
+
+    if (uuid == NULL)
+      continue;
+
+    g_hash_table_add (listed, (gpointer) uuid);
+
+    old = g_hash_table_lookup (self->extensions_by_uuid, uuid);
+    if (old != NULL) {
+      deap_shell_extension_update (old, deap_shell_extension_get_info (extension));
+    } else {
+      g_hash_table_insert (self->extensions_by_uuid, (gpointer) uuid, g_object_ref (extension));
+      append_extension (self, extension);
+    }
+  }
+
+  g_hash_table_iter_init (&iter, self->extensions_by_uuid);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    if (!g_hash_table_contains (listed, key)) {
+      remove_extension (self, value);
+      g_hash_table_iter_remove (&iter);
+    }
   }
 
-  return ret;
+  g_ptr_array_unref (extensions);
 }
 
-static GtkWidget *
-create_extension_list_row (gpointer user_data)
+static void
+clear_extensions (DeapGnomeShell *self)
 {
-  ShellExtensionInfo *info;
-  GtkWidget *row;
-  GtkWidget *hbox;
-  GtkWidget *name;
+  if (self->populate_source_id) {
+    g_source_remove (self->populate_source_id);
+    self->populate_source_id = 0;
+  }
 
-  info = (ShellExtensionInfo *)user_data;
+  g_clear_pointer (&self->pending_extensions, g_ptr_array_unref);
+  g_list_store_remove_all (self->extensions);
+  g_hash_table_remove_all (self->extensions_by_uuid);
+}
 
-  row = gtk_list_box_row_new ();
-  g_object_set_data (G_OBJECT (row), "uuid", g_strdup (info->uuid));
+static void
+populate_extensions (DeapGnomeShell *self,
+                     GPtrArray      *extensions)
+{
+  guint i;
+
+  /*
+   * Already shown, or being shown, once: this is a re-sync, or the live
+   * listing replacing the cached one. Records still pending are the
+   * same objects, so they are updated in place just as well.
+   */
+  if (g_hash_table_size (self->extensions_by_uuid) > 0) {
+    reconcile_extensions (self, extensions);
+    return;
+  }
 
-  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  clear_extensions (self);
 
-  name = gtk_label_new (info->name);
-  gtk_box_pack_start (GTK_BOX (hbox), name, TRUE, FALSE, 0);
+  for (i = 0; i < extensions->len; i++) {
+    DeapShellExtension *extension = g_ptr_array_index (extensions, i);
+    const gchar *uuid = deap_shell_extension_get_uuid (extension);
 
-  gtk_container_add (GTK_CONTAINER (row), hbox);
-  gtk_widget_show_all (row);
+    set_next_ordinal (self, extension);
 
-  return row;
+    if (uuid != NULL)
+      g_hash_table_insert (self->extensions_by_uuid, (gpointer) uuid, g_object_ref (extension));
+  }
+
+  self->pending_extensions = extensions;
+  self->pending_position = 0;
+
+  if (extensions->len == 0) {
+    populate_extensions_cb (self);
+    return;
+  }
+
+  self->populate_source_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                              populate_extensions_cb,
+                                              self,
+                                              NULL);
 }
 
+/* --- Extension Cache --- */
 static void
-add_row_into_extension_list_func (gpointer data,
-                                  gpointer user_data)
+show_cached_extensions (DeapGnomeShell *self)
 {
-  DeapGnomeShell *self;
-  GtkWidget *row;
+  self->cached_extensions = deap_extension_cache_load (&self->cached_shell_version);
+  if (self->cached_extensions == NULL)
+    return;
 
-  self = DEAP_GNOME_SHELL (user_data);
-  row = create_extension_list_row (data);
+  deap_debug_msg ("Showing %" G_GSIZE_FORMAT " cached extensions of Shell %s",
+                  g_variant_n_children (self->cached_extensions),
+                  self->cached_shell_version);
+
+  self->showing_cached = TRUE;
+  deap_metrics_counter_add ("extensions.cache.hits", 1);
+
+  populate_extensions (self, deap_shell_extension_parse_list (self->cached_extensions));
+}
+
+/*
+ * drop_stale_cached_extensions
+ *
+ * The cache was taken from another Shell, upgraded since: its states
+ * and even its extensions may no longer hold, so rather than showing
+ * them until ListExtensions returns, the page waits empty.
+ */
+static void
+drop_stale_cached_extensions (DeapGnomeShell *self)
+{
+  if (!self->showing_cached ||
+      g_strcmp0 (self->cached_shell_version, self->shell_version) == 0)
+    return;
+
+  deap_debug_msg ("Dropping extensions cached from Shell %s, running %s",
+                  self->cached_shell_version, self->shell_version);
 
-  gtk_list_box_insert (GTK_LIST_BOX (self->extension_list_box), row, -1);
+  self->showing_cached = FALSE;
+  clear_extensions (self);
+}
+
+static gboolean
+same_serialized (GVariant *a,
+                 GVariant *b)
+{
+  return g_variant_get_size (a) == g_variant_get_size (b) &&
+         memcmp (g_variant_get_data (a), g_variant_get_data (b), g_variant_get_size (a)) == 0;
+}
+
+/*
+ * save_extensions
+ *
+ * Caches a live ListExtensions reply under the ShellVersion, so it is
+ * held back until that is known. A listing identical to the cached one
+ * is not written again.
+ */
+static void
+save_extensions (DeapGnomeShell *self,
+                 GVariant       *extensions)
+{
+  if (self->shell_version == NULL) {
+    if (self->unsaved_extensions != extensions) {
+      g_clear_pointer (&self->unsaved_extensions, g_variant_unref);
+      self->unsaved_extensions = g_variant_ref (extensions);
+    }
+    return;
+  }
+
+  if (self->cached_extensions != NULL &&
+      g_strcmp0 (self->cached_shell_version, self->shell_version) == 0 &&
+      same_serialized (self->cached_extensions, extensions))
+    deap_trace_msg ("Extension cache is up to date");
+  else
+    deap_extension_cache_save (self->shell_version, extensions);
+
+  /* Drops the mapping once no record points into it any more */
+  g_clear_pointer (&self->cached_extensions, g_variant_unref);
+  g_clear_pointer (&self->cached_shell_version, g_free);
+  g_clear_pointer (&self->unsaved_extensions, g_variant_unref);
+}
+/* --- End of Extension Cache --- */
+
+/*
+ * on_extension_state_changed
+ *
+ * org.gnome.Shell.Extensions
+ *
+ * Signal: ExtensionStateChanged (s uuid, a{sv} state)
+ *
+ * Only the record of the given UUID is touched: its properties are
+ * updated in place (the bound row labels follow), a new UUID is appended
+ * and an uninstalled one is removed.
+ */
+static void
+on_extension_state_changed (GDBusConnection *connection,
+                            const gchar     *sender_name,
+                            const gchar     *object_path,
+                            const gchar     *interface_name,
+                            const gchar     *signal_name,
+                            GVariant        *parameters,
+                            gpointer         user_data)
+{
+  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  g_autoptr(GVariant) info = NULL;
+  DeapShellExtension *extension;
+  const gchar *uuid;
+  gdouble state = 0;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv})")))
+    return;
+
+  g_variant_get (parameters, "(&s@a{sv})", &uuid, &info);
+  g_variant_lookup (info, "state", "d", &state);
+
+  deap_trace_msg ("ExtensionStateChanged: %s, state %d", uuid, (gint) state);
+
+  extension = g_hash_table_lookup (self->extensions_by_uuid, uuid);
+
+  if ((gint) state == DEAP_SHELL_EXTENSION_STATE_UNINSTALLED) {
+    if (extension != NULL) {
+      remove_extension (self, extension);
+      g_hash_table_remove (self->extensions_by_uuid, uuid);
+    }
+  } else if (extension != NULL) {
+    deap_shell_extension_update (extension, info);
+  } else {
+    /* The signal carries the UUID even when the a{sv} does not */
+    if (!g_variant_lookup (info, "uuid", "&s", NULL)) {
+      GVariantDict dict;
+
+      g_variant_dict_init (&dict, info);
+      g_variant_dict_insert (&dict, "uuid", "s", uuid);
+      g_variant_unref (info);
+      info = g_variant_ref_sink (g_variant_dict_end (&dict));
+    }
+
+    extension = deap_shell_extension_new (info);
+
+    g_hash_table_insert (self->extensions_by_uuid,
+                         (gpointer) deap_shell_extension_get_uuid (extension),
+                         extension);
+
+    append_extension (self, extension);
+  }
 }
 
 static void
@@ -177,51 +536,110 @@ get_extension_list_finish (GObject      *source,
                            GAsyncResult *res,
                            gpointer      user_data)
 {
-  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  DeapCall *call = user_data;
+  DeapGnomeShell *self = deap_call_get_owner (call);
   g_autoptr(GVariant) ret = NULL;
   g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_dbus_shell_extensions_call_list_extensions_finish (DEAP_DBUS_SHELL_EXTENSIONS (source),
+                                                          &ret,
+                                                          res,
+                                                          &error);
+  if (!deap_call_complete (call, &error))
+    return;
+
+  deap_trace_flow_end (self->list_extensions_flow, "ListExtensions");
+  self->list_extensions_flow = 0;
 
-  ret = g_dbus_proxy_call_finish (self->shell_extension,
-                                        res,
-                                        &error);
   if (error) {
     deap_warn_msg ("Error org.gnome.ShellExtensions.ListExtensions: %s", error->message);
+    deap_profile_page_populated ("gnome-shell");
     return;
   }
 
-  self->shell_extension_infos = parse_from_serialized_dbus_data (ret);
-  g_ptr_array_foreach (self->shell_extension_infos, add_row_into_extension_list_func, self);
+  self->showing_cached = FALSE;
+  populate_extensions (self, deap_shell_extension_parse_list (ret));
+  save_extensions (self, ret);
 }
 
 static void
 get_extension_list (DeapGnomeShell *self)
 {
+  DeapCall *call;
+
   g_return_if_fail (self != NULL);
 
-  g_dbus_proxy_call (self->shell_extension,
-                     "ListExtensions",
-                     NULL,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     (GAsyncReadyCallback) get_extension_list_finish,
-                     self);
+  self->list_extensions_flow = deap_trace_flow_begin ("ListExtensions");
+  call = deap_call_new ("org.gnome.Shell.Extensions.ListExtensions", DEAP_CALL_LISTING, self, self->extension_cancellable);
+  deap_dbus_shell_extensions_call_list_extensions (self->shell_extension,
+                                                   deap_call_get_cancellable (call),
+                                                   get_extension_list_finish,
+                                                   call);
+}
+
+static void
+unsubscribe_extension_signals (DeapGnomeShell *self)
+{
+  if (self->extension_state_changed_id) {
+    g_dbus_connection_signal_unsubscribe (g_dbus_proxy_get_connection (G_DBUS_PROXY (self->shell_extension)),
+                                          self->extension_state_changed_id);
+    self->extension_state_changed_id = 0;
+  }
 }
 
+/*
+ * shell_extension_proxy_acquired_cb
+ *
+ * Also runs when org.gnome.Shell got a new owner: the proxy (and with
+ * it possibly the connection) is swapped and the list re-synced, which
+ * patches the existing rows instead of rebuilding them.
+ */
 static void
 shell_extension_proxy_acquired_cb (GObject      *source,
                                    GAsyncResult *res,
                                    gpointer      user_data)
 {
-  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  DeapGnomeShell *self;
+  g_autoptr(GObject) proxy = NULL;
   g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
 
-  self->shell_extension = g_dbus_proxy_new_for_bus_finish (res, &error);
+  proxy = deap_bus_manager_get_proxy_finish (DEAP_BUS_MANAGER (source), res, &error);
 
-  if (error)
+  /* Disposed */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = DEAP_GNOME_SHELL (user_data);
+
+  deap_trace_flow_end (self->extension_flow, "org.gnome.Shell.Extensions proxy");
+  self->extension_flow = 0;
+
+  if (error) {
     deap_warn_msg ("Error acquiring org.gnome.Shell.Extensions: %s", error->message);
-  else {
+    deap_profile_page_populated ("gnome-shell");
+  } else {
     deap_info_msg ("org.gnome.Shell.Extensions successfully acquired");
+
+    unsubscribe_extension_signals (self);
+    g_set_object (&self->shell_extension, proxy);
+
+    /*
+     * The proxy does not subscribe to the interface's signals, this is
+     * the only one the page needs, so the bus only routes that one here.
+     */
+    self->extension_state_changed_id =
+      g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (G_DBUS_PROXY (self->shell_extension)),
+                                          "org.gnome.Shell",
+                                          "org.gnome.Shell.Extensions",
+                                          "ExtensionStateChanged",
+                                          "/org/gnome/Shell",
+                                          NULL,
+                                          G_DBUS_SIGNAL_FLAGS_NONE,
+                                          on_extension_state_changed,
+                                          self,
+                                          NULL);
     get_extension_list (self);
   }
 }
@@ -229,58 +647,47 @@ shell_extension_proxy_acquired_cb (GObject      *source,
 
 
 /* --- Shell Proxy --- */
-/*
- * execute_focus_search_cb
- *
- * org.gnome.Shell
- *
- * Method: FocusSearch
- * Property: None
- * Return: None
- */
-static gboolean
-execute_focus_search_cb (GtkButton *button,
-                         gpointer   user_data)
+static void
+get_shell_version_finish (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data)
 {
-  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  DeapCall *call = user_data;
+  DeapGnomeShell *self = deap_call_get_owner (call);
+  g_autoptr(GVariant) ret = NULL;
+  g_autoptr(GVariant) value = NULL;
+  g_autoptr(GError) error = NULL;
 
-  g_dbus_proxy_call (self->shell,
-                     "FocusSearch",
-                     NULL,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     NULL,
-                     self);
+  ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+  if (!deap_call_complete (call, &error))
+    return;
 
-  return TRUE;
-}
+  if (error) {
+    deap_warn_msg ("Error getting ShellVersion: %s", error->message);
+    return;
+  }
 
-/*
- * execute_show_applications_cb
- *
- * org.gnome.Shell
- *
- * Method: ShowApplications
- * Property: None
- * Return: None
- */
-static gboolean
-execute_show_applications_cb (GtkButton *button,
-                             gpointer   user_data)
-{
-  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  g_variant_get (ret, "(v)", &value);
+  if (!g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+    return;
 
-  g_dbus_proxy_call (self->shell,
-                     "ShowApplications",
-                     NULL,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     NULL,
-                     self);
+  /* Keeps deap_dbus_shell_get_shell_version() meaningful */
+  g_dbus_proxy_set_cached_property (G_DBUS_PROXY (self->shell), "ShellVersion", value);
 
-  return TRUE;
+  g_free (self->shell_version);
+  self->shell_version = deap_dbus_shell_dup_shell_version (self->shell);
+  if (self->shell_version != NULL && *self->shell_version == '\0')
+    g_clear_pointer (&self->shell_version, g_free);
+
+  deap_debug_msg ("ShellVersion: %s", self->shell_version);
+
+  if (self->shell_version == NULL)
+    return;
+
+  drop_stale_cached_extensions (self);
+
+  if (self->unsaved_extensions != NULL)
+    save_extensions (self, self->unsaved_extensions);
 }
 
 /*
@@ -290,30 +697,31 @@ execute_show_applications_cb (GtkButton *button,
  *
  * Method: None
  * Property: ShellVersion
- * Return gnome shell version
  * Ret type: String
+ *
+ * The proxy does not load properties, this is the one deap reads.
  */
-static const gchar *
+static void
 get_shell_version (DeapGnomeShell *self)
 {
-  g_autoptr(GVariant) gvar_ver = NULL;
-  const gchar *ret;
-  gsize len;
-
-  g_return_val_if_fail (self != NULL, NULL);
-  g_return_val_if_fail (self->shell != NULL, NULL);
-
-  gvar_ver = g_dbus_proxy_get_cached_property (self->shell, "ShellVersion");
-  if (gvar_ver == NULL) {
-    deap_warn_msg ("ShellVersion property is not cached yet");
-    return NULL;
-  }
+  DeapCall *call;
 
-  ret = g_variant_get_string (gvar_ver, &len);
-  if (len == 0)
-    return NULL;
-
-  return ret;
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->shell != NULL);
+
+  call = deap_call_new ("org.freedesktop.DBus.Properties.Get(ShellVersion)", DEAP_CALL_PROPERTY, self, self->cancellable);
+  g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (self->shell)),
+                          "org.gnome.Shell",
+                          "/org/gnome/Shell",
+                          "org.freedesktop.DBus.Properties",
+                          "Get",
+                          g_variant_new ("(ss)", "org.gnome.Shell", "ShellVersion"),
+                          G_VARIANT_TYPE ("(v)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          deap_call_get_cancellable (call),
+                          get_shell_version_finish,
+                          call);
 }
 
 static void
@@ -321,32 +729,57 @@ shell_proxy_acquired_cb (GObject      *source,
                          GAsyncResult *res,
                          gpointer      user_data)
 {
-  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  DeapGnomeShell *self;
+  g_autoptr(GObject) proxy = NULL;
   g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  proxy = deap_bus_manager_get_proxy_finish (DEAP_BUS_MANAGER (source), res, &error);
+
+  /* Disposed */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = DEAP_GNOME_SHELL (user_data);
 
-  self->shell = g_dbus_proxy_new_for_bus_finish (res, &error);
+  deap_trace_flow_end (self->shell_flow, "org.gnome.Shell proxy");
+  self->shell_flow = 0;
 
   if (error)
     deap_warn_msg ("Error acquiring org.gnome.Shell: %s", error->message);
   else {
     deap_info_msg ("org.gnome.Shell successfully acquired");
-    self->shell_version = g_strdup (get_shell_version (self));
+    g_set_object (&self->shell, proxy);
+    get_shell_version (self);
   }
 }
 /* --- End of Shell Proxy --- */
 
 
 /* --- Callbacks for Widgets --- */
-static const gchar *
-get_uuid_from_row (GtkListBoxRow *row)
+static DeapShellExtension *
+get_extension_from_row (DeapGnomeShell *self,
+                        GtkListBoxRow  *row)
 {
-  return g_object_get_data (G_OBJECT (row), "uuid");
+  return g_list_model_get_item (G_LIST_MODEL (self->extensions),
+                                gtk_list_box_row_get_index (row));
 }
 
-static gboolean
-is_uuid_in_row (GtkListBoxRow *row)
+static void
+launch_extension_prefs_finish (GObject      *source,
+                               GAsyncResult *res,
+                               gpointer      user_data)
 {
-  return get_uuid_from_row (row) != NULL;
+  g_autoptr(GError) error = NULL;
+
+  deap_dbus_shell_extensions_call_launch_extension_prefs_finish (DEAP_DBUS_SHELL_EXTENSIONS (source),
+                                                                 res,
+                                                                 &error);
+  if (!deap_call_complete (user_data, &error))
+    return;
+
+  if (error)
+    deap_warn_msg ("Error org.gnome.Shell.Extensions.LaunchExtensionPrefs: %s", error->message);
 }
 
 static void
@@ -355,8 +788,10 @@ extension_option_launch_cb (GSimpleAction *action,
                                    gpointer       user_data)
 {
   DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  g_autoptr(DeapShellExtension) extension = NULL;
   GtkListBoxRow *row = NULL;
   const gchar *uuid = NULL;
+  DeapCall *call;
 
   DEAP_TRACE_ENTRY;
 
@@ -366,20 +801,19 @@ extension_option_launch_cb (GSimpleAction *action,
     return;
   }
 
-  uuid = get_uuid_from_row (row);
+  extension = get_extension_from_row (self, row);
+  uuid = extension ? deap_shell_extension_get_uuid (extension) : NULL;
   if (uuid == NULL) {
     deap_warn_msg ("The selected row has no UUID");
     return;
   }
 
-  g_dbus_proxy_call (self->shell_extension,
-                     "LaunchExtensionPrefs",
-                     g_variant_new ("(s)", g_strdup (uuid)),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     NULL,
-                     NULL);
+  call = deap_call_new ("org.gnome.Shell.Extensions.LaunchExtensionPrefs", DEAP_CALL_ACTION, self, self->extension_cancellable);
+  deap_dbus_shell_extensions_call_launch_extension_prefs (self->shell_extension,
+                                                          uuid,
+                                                          deap_call_get_cancellable (call),
+                                                          launch_extension_prefs_finish,
+                                                          call);
   deap_trace_msg ("UUID: %s", uuid);
 
   DEAP_TRACE_EXIT;
@@ -423,8 +857,13 @@ on_listbox_row_selected_cb (GtkListBox    *box,
                             gpointer       user_data)
 {
   DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+  g_autoptr(DeapShellExtension) extension = NULL;
+
+  if (row != NULL)
+    extension = get_extension_from_row (self, row);
 
-  update_selection_actions (self->action_group, row != NULL && is_uuid_in_row (row));
+  update_selection_actions (self->action_group,
+                            extension != NULL && deap_shell_extension_get_uuid (extension) != NULL);
 }
 /* --- End of Callbacks --- */
 
@@ -433,6 +872,19 @@ on_listbox_row_selected_cb (GtkListBox    *box,
 static void
 deap_gnome_shell_dispose (GObject *object)
 {
+  DeapGnomeShell *self = DEAP_GNOME_SHELL (object);
+
+  if (self->populate_source_id) {
+    g_source_remove (self->populate_source_id);
+    self->populate_source_id = 0;
+  }
+
+  unsubscribe_extension_signals (self);
+
+  /* In-flight calls and proxy requests must not call back into us */
+  g_cancellable_cancel (self->cancellable);
+  g_cancellable_cancel (self->extension_cancellable);
+
   G_OBJECT_CLASS (deap_gnome_shell_parent_class)->dispose (object);
 }
 
@@ -441,19 +893,19 @@ deap_gnome_shell_finalize (GObject *object)
 {
   DeapGnomeShell *self = DEAP_GNOME_SHELL (object);
 
-  g_cancellable_cancel (self->cancellable);
   g_clear_object (&self->cancellable);
-
-  g_cancellable_cancel (self->extension_cancellable);
   g_clear_object (&self->extension_cancellable);
 
   g_clear_object (&self->shell);
   g_clear_object (&self->shell_extension);
 
-  if (self->shell_extension_infos) {
-    g_ptr_array_unref (self->shell_extension_infos);
-    self->shell_extension_infos = NULL;
-  }
+  g_clear_pointer (&self->pending_extensions, g_ptr_array_unref);
+  g_clear_pointer (&self->extensions_by_uuid, g_hash_table_unref);
+  g_clear_object (&self->extensions);
+
+  g_clear_pointer (&self->cached_extensions, g_variant_unref);
+  g_clear_pointer (&self->cached_shell_version, g_free);
+  g_clear_pointer (&self->unsaved_extensions, g_variant_unref);
 
   if (self->shell_version) {
     g_free (self->shell_version);
@@ -478,8 +930,6 @@ deap_gnome_shell_class_init (DeapGnomeShellClass *klass)
   gtk_widget_class_bind_template_child (widget_class, DeapGnomeShell, show_applications);
   gtk_widget_class_bind_template_child (widget_class, DeapGnomeShell, focus_search);
   gtk_widget_class_bind_template_child (widget_class, DeapGnomeShell, popover_menu);
-  gtk_widget_class_bind_template_callback (widget_class, execute_show_applications_cb);
-  gtk_widget_class_bind_template_callback (widget_class, execute_focus_search_cb);
   gtk_widget_class_bind_template_callback (widget_class, on_listbox_button_press_cb);
   gtk_widget_class_bind_template_callback (widget_class, on_listbox_row_selected_cb);
 
@@ -502,41 +952,116 @@ create_action_group (DeapGnomeShell *self)
   gtk_widget_insert_action_group (GTK_WIDGET (self), "extension", self->action_group);
 }
 
+static void
+acquire_shell_proxy (DeapGnomeShell *self)
+{
+  self->shell_flow = deap_trace_flow_begin ("org.gnome.Shell proxy");
+  deap_bus_manager_get_proxy_async (deap_bus_manager_get_default (),
+                                    G_BUS_TYPE_SESSION,
+                                    DEAP_DBUS_TYPE_SHELL_PROXY,
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                    "org.gnome.Shell",
+                                    "/org/gnome/Shell",
+                                    "org.gnome.Shell",
+                                    self->cancellable,
+                                    shell_proxy_acquired_cb, /* Callback */
+                                    self);
+}
+
+static void
+acquire_shell_extension_proxy (DeapGnomeShell *self)
+{
+  self->extension_flow = deap_trace_flow_begin ("org.gnome.Shell.Extensions proxy");
+  deap_bus_manager_get_proxy_async (deap_bus_manager_get_default (),
+                                    G_BUS_TYPE_SESSION,
+                                    DEAP_DBUS_TYPE_SHELL_EXTENSIONS_PROXY,
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                    "org.gnome.Shell",
+                                    "/org/gnome/Shell",
+                                    "org.gnome.Shell.Extensions",
+                                    self->extension_cancellable,
+                                    shell_extension_proxy_acquired_cb,
+                                    self);
+}
+
+/* gnome-shell restarted (e.g. Alt+F2 r) or the session bus came back */
+static void
+on_shell_appeared (DeapBusManager *manager,
+                   GBusType        bus_type,
+                   const gchar    *name,
+                   gpointer        user_data)
+{
+  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+
+  if (bus_type != G_BUS_TYPE_SESSION)
+    return;
+
+  acquire_shell_proxy (self);
+  acquire_shell_extension_proxy (self);
+}
+
+static void
+on_shell_vanished (DeapBusManager *manager,
+                   GBusType        bus_type,
+                   const gchar    *name,
+                   gpointer        user_data)
+{
+  DeapGnomeShell *self = DEAP_GNOME_SHELL (user_data);
+
+  if (bus_type != G_BUS_TYPE_SESSION)
+    return;
+
+  /* Rows are kept; they are re-synced once the Shell is back */
+  g_clear_pointer (&self->shell_version, g_free);
+}
+
 static void
 register_gdbus_proxies (DeapGnomeShell *self)
 {
+  DeapBusManager *manager = deap_bus_manager_get_default ();
+
   g_return_if_fail (self != NULL);
 
+  g_signal_connect_object (manager,
+                           "name-appeared::org.gnome.Shell",
+                           G_CALLBACK (on_shell_appeared),
+                           self,
+                           0);
+  g_signal_connect_object (manager,
+                           "name-vanished::org.gnome.Shell",
+                           G_CALLBACK (on_shell_vanished),
+                           self,
+                           0);
+
   /* org.gnome.Shell */
   self->cancellable = g_cancellable_new ();
-  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            NULL, /* GDBusInterfaceInfo */
-                            "org.gnome.Shell",
-                            "/org/gnome/Shell",
-                            "org.gnome.Shell",
-                            self->cancellable,
-                            shell_proxy_acquired_cb, /* Callback */
-                            self);
+  acquire_shell_proxy (self);
 
   /* org.gnome.Shell.Extensions */
   self->extension_cancellable = g_cancellable_new ();
-  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            NULL,
-                            "org.gnome.Shell",
-                            "/org/gnome/Shell",
-                            "org.gnome.Shell.Extensions",
-                            self->extension_cancellable,
-                            shell_extension_proxy_acquired_cb,
-                            self);
+  acquire_shell_extension_proxy (self);
 }
 
 static void
 deap_gnome_shell_init (DeapGnomeShell *self)
 {
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->extensions = g_list_store_new (DEAP_TYPE_SHELL_EXTENSION);
+  self->extensions_by_uuid = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  gtk_list_box_bind_model (GTK_LIST_BOX (self->extension_list_box),
+                           G_LIST_MODEL (self->extensions),
+                           create_extension_list_row,
+                           self,
+                           NULL);
+
+  /* Rendered right away, then reconciled with ListExtensions */
+  show_cached_extensions (self);
+
   create_action_group (self);
   register_gdbus_proxies (self);
 }
@@ -559,3 +1084,46 @@ deap_gnome_shell_get_instance (void)
 
   return instance;
 }
+
+/*
+ * deap_gnome_shell_get_extensions
+ *
+ * Returns: (transfer none): the DeapShellExtension items shown, which
+ * grow in batches while a listing is spliced in
+ */
+GListModel *
+deap_gnome_shell_get_extensions (DeapGnomeShell *self)
+{
+  g_return_val_if_fail (DEAP_IS_GNOME_SHELL (self), NULL);
+
+  return G_LIST_MODEL (self->extensions);
+}
+
+/*
+ * deap_gnome_shell_select_extension
+ *
+ * Selects and focuses the row of @extension.
+ * Returns: FALSE if it is not shown (yet).
+ */
+gboolean
+deap_gnome_shell_select_extension (DeapGnomeShell     *self,
+                                   DeapShellExtension *extension)
+{
+  GtkListBoxRow *row;
+  guint position;
+
+  g_return_val_if_fail (DEAP_IS_GNOME_SHELL (self), FALSE);
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (extension), FALSE);
+
+  if (!find_extension_position (self, extension, &position))
+    return FALSE;
+
+  row = gtk_list_box_get_row_at_index (GTK_LIST_BOX (self->extension_list_box), position);
+  if (row == NULL)
+    return FALSE;
+
+  gtk_list_box_select_row (GTK_LIST_BOX (self->extension_list_box), row);
+  gtk_widget_grab_focus (GTK_WIDGET (row));
+
+  return TRUE;
+}
@@ -22,12 +22,18 @@
 
 #include <gtk/gtk.h>
 
+#include "deap-shell-extension.h"
+
 G_BEGIN_DECLS
 
 #define DEAP_TYPE_GNOME_SHELL (deap_gnome_shell_get_type ())
 
 G_DECLARE_FINAL_TYPE (DeapGnomeShell, deap_gnome_shell, DEAP, GNOME_SHELL, GtkBox)
 
-GtkWidget *     deap_gnome_shell_get_instance   (void);
+GtkWidget *     deap_gnome_shell_get_instance       (void);
+
+GListModel *    deap_gnome_shell_get_extensions     (DeapGnomeShell     *self);
+gboolean        deap_gnome_shell_select_extension   (DeapGnomeShell     *self,
+                                                     DeapShellExtension *extension);
 
 G_END_DECLS
@@ -0,0 +1,91 @@
+/* deap-json.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Just enough JSON for the metrics dump and the trace file, which are
+ * written by hand rather than pulling json-glib in.
+ *
+ * This file must not log: the log writer thread goes through
+ * deap-metrics.c, which uses it.
+ */
+
+#include "deap-json.h"
+
+/*
+ * deap_json_append_string
+ *
+ * Appends @str as a quoted JSON string. UTF-8 goes through as is,
+ * quotes, backslashes and control characters are escaped, and bytes
+ * which are not valid UTF-8 (a hostname may have any) become U+FFFD,
+ * so the output always parses.
+ */
+void
+deap_json_append_string (GString     *json,
+                         const gchar *str)
+{
+  const gchar *p = str;
+
+  g_return_if_fail (json != NULL);
+  g_return_if_fail (str != NULL);
+
+  g_string_append_c (json, '"');
+
+  while (*p != '\0') {
+    gunichar c = g_utf8_get_char_validated (p, -1);
+
+    if (c == (gunichar) -1 || c == (gunichar) -2) {
+      g_string_append (json, "\\ufffd");
+      p++;
+      continue;
+    }
+
+    switch (c) {
+      case '"':
+        g_string_append (json, "\\\"");
+        break;
+
+      case '\\':
+        g_string_append (json, "\\\\");
+        break;
+
+      case '\n':
+        g_string_append (json, "\\n");
+        break;
+
+      case '\r':
+        g_string_append (json, "\\r");
+        break;
+
+      case '\t':
+        g_string_append (json, "\\t");
+        break;
+
+      default:
+        if (c < 0x20)
+          g_string_append_printf (json, "\\u%04x", c);
+        else
+          g_string_append_len (json, p, g_utf8_next_char (p) - p);
+    }
+
+    p = g_utf8_next_char (p);
+  }
+
+  g_string_append_c (json, '"');
+}
@@ -0,0 +1,315 @@
+/* deap-login1-session.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapLogin1Session"
+
+#include "deap-config.h"
+#include "deap-login1-session.h"
+
+#include <string.h>
+
+/*
+ * deap_login1_session_parse_list
+ *
+ * @list: the a(susso) returned by ListSessions
+ * @sessions: (element-type DeapLogin1Session): records are appended here
+ * @strings: their strings are interned here
+ * @session_index: maps an interned session ID to its position in @sessions + 1
+ *
+ * Widget-free, so benchmarks/parsers.c can time it on its own. A session
+ * listed twice is only appended once; no rows are created.
+ *
+ * Returns: the number of records appended
+ */
+guint
+deap_login1_session_parse_list (GVariant     *list,
+                                GArray       *sessions,
+                                GStringChunk *strings,
+                                GHashTable   *session_index)
+{
+  GVariantIter iter;
+  const gchar *session_id;
+  guint32 user_id;
+  const gchar *user_name;
+  const gchar *seat_id;
+  guint n_before;
+
+  g_return_val_if_fail (list != NULL, 0);
+  g_return_val_if_fail (g_variant_is_of_type (list, G_VARIANT_TYPE ("a(susso)")), 0);
+  g_return_val_if_fail (sessions != NULL, 0);
+  g_return_val_if_fail (strings != NULL, 0);
+  g_return_val_if_fail (session_index != NULL, 0);
+
+  n_before = sessions->len;
+
+  g_variant_iter_init (&iter, list);
+  while (g_variant_iter_next (&iter, "(&su&s&s&o)", &session_id, &user_id, &user_name, &seat_id, NULL)) {
+    DeapLogin1Session session = { NULL, };
+
+    if (g_hash_table_contains (session_index, session_id))
+      continue;
+
+    session.session_id = g_string_chunk_insert_const (strings, session_id);
+    session.user_name = g_string_chunk_insert_const (strings, user_name);
+    session.seat_id = g_string_chunk_insert_const (strings, seat_id);
+    session.user_id = user_id;
+
+    g_array_append_val (sessions, session);
+    g_hash_table_insert (session_index, (gpointer) session.session_id, GUINT_TO_POINTER (sessions->len));
+  }
+
+  return sessions->len - n_before;
+}
+
+/*
+ * intern_len
+ *
+ * g_string_chunk_insert_len() would copy @str every time; values are
+ * NUL-terminated in a scratch buffer so that they are deduplicated like
+ * the strings of deap_login1_session_parse_list() are.
+ */
+static const gchar *
+intern_len (GStringChunk *strings,
+            const gchar  *str,
+            gsize         len)
+{
+  g_autofree gchar *copy = NULL;
+  gchar buf[256];
+
+  if (len < sizeof buf) {
+    memcpy (buf, str, len);
+    buf[len] = '\0';
+    return g_string_chunk_insert_const (strings, buf);
+  }
+
+  copy = g_strndup (str, len);
+  return g_string_chunk_insert_const (strings, copy);
+}
+
+/*
+ * deap_login1_session_get_state_dir
+ *
+ * Returns: (transfer full): logind's /run/systemd/sessions, below
+ * $DEAP_SYSTEMD_ROOT if that is set, e.g. to a fixture tree
+ */
+gchar *
+deap_login1_session_get_state_dir (void)
+{
+  const gchar *root = g_getenv ("DEAP_SYSTEMD_ROOT");
+
+  return g_build_filename (root != NULL ? root : "/", "run", "systemd", "sessions", NULL);
+}
+
+/*
+ * deap_login1_session_is_state_file
+ *
+ * logind keeps one file per session in /run/systemd/sessions, named
+ * after the session ID, next to "<id>.ref" FIFOs and the ".#<id>XXXXXX"
+ * temporaries it renames over them. Session IDs never hold a dot.
+ */
+gboolean
+deap_login1_session_is_state_file (const gchar *name)
+{
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  return *name != '\0' && strchr (name, '.') == NULL;
+}
+
+/*
+ * deap_login1_session_id_is_valid
+ *
+ * As logind's session_id_valid(): letters and digits only, so "c1" for
+ * a seatless session is fine, while an empty ID or one with a path or
+ * a space never reaches the bus.
+ */
+gboolean
+deap_login1_session_id_is_valid (const gchar *session_id)
+{
+  const gchar *p;
+
+  g_return_val_if_fail (session_id != NULL, FALSE);
+
+  if (*session_id == '\0')
+    return FALSE;
+
+  for (p = session_id; *p != '\0'; p++)
+    if (!g_ascii_isalnum (*p))
+      return FALSE;
+
+  return TRUE;
+}
+
+/*
+ * deap_login1_session_parse_state
+ *
+ * @contents: a logind session state file, KEY=VALUE lines
+ * @session: filled with @session_id and whatever of UID, USER and SEAT
+ * the file has, interned into @strings
+ *
+ * A session without a seat gets "", as in ListSessions.
+ *
+ * Returns: FALSE if UID or USER is missing, in which case the details
+ * have to come from the bus
+ */
+gboolean
+deap_login1_session_parse_state (const gchar       *session_id,
+                                 const gchar       *contents,
+                                 gsize              length,
+                                 GStringChunk      *strings,
+                                 DeapLogin1Session *session)
+{
+  const gchar *line = contents;
+  const gchar *end = contents + length;
+  gboolean has_user_id = FALSE;
+
+  g_return_val_if_fail (session_id != NULL, FALSE);
+  g_return_val_if_fail (contents != NULL || length == 0, FALSE);
+  g_return_val_if_fail (strings != NULL, FALSE);
+  g_return_val_if_fail (session != NULL, FALSE);
+
+  memset (session, 0, sizeof *session);
+  session->session_id = g_string_chunk_insert_const (strings, session_id);
+
+  while (line < end) {
+    const gchar *eol = memchr (line, '\n', end - line);
+    const gchar *value;
+    gsize value_len;
+
+    if (eol == NULL)
+      eol = end;
+
+    value = memchr (line, '=', eol - line);
+    if (value != NULL) {
+      gsize key_len = value - line;
+
+      value++;
+      value_len = eol - value;
+
+#define KEY_IS(k) (key_len == sizeof (k) - 1 && memcmp (line, k, key_len) == 0)
+      if (KEY_IS ("UID")) {
+        g_autofree gchar *uid = g_strndup (value, value_len);
+        guint64 user_id;
+
+        if (g_ascii_string_to_unsigned (uid, 10, 0, G_MAXUINT32, &user_id, NULL)) {
+          session->user_id = (guint32) user_id;
+          has_user_id = TRUE;
+        }
+      } else if (KEY_IS ("USER")) {
+        session->user_name = intern_len (strings, value, value_len);
+      } else if (KEY_IS ("SEAT")) {
+        session->seat_id = intern_len (strings, value, value_len);
+      }
+#undef KEY_IS
+    }
+
+    line = eol + 1;
+  }
+
+  if (session->seat_id == NULL)
+    session->seat_id = g_string_chunk_insert_const (strings, "");
+
+  return has_user_id && session->user_name != NULL;
+}
+
+/*
+ * deap_login1_session_read_dir
+ *
+ * The state file counterpart of deap_login1_session_parse_list(): reads
+ * every session of @path, a /run/systemd/sessions. A file which went
+ * away meanwhile is skipped; one missing its details is appended
+ * without them, with a NULL user_name.
+ *
+ * Returns: the number of records appended
+ */
+guint
+deap_login1_session_read_dir (const gchar   *path,
+                              GArray        *sessions,
+                              GStringChunk  *strings,
+                              GHashTable    *session_index,
+                              GError       **error)
+{
+  g_autoptr(GDir) dir = NULL;
+  const gchar *name;
+  guint n_before;
+
+  g_return_val_if_fail (path != NULL, 0);
+  g_return_val_if_fail (sessions != NULL, 0);
+  g_return_val_if_fail (strings != NULL, 0);
+  g_return_val_if_fail (session_index != NULL, 0);
+
+  dir = g_dir_open (path, 0, error);
+  if (dir == NULL)
+    return 0;
+
+  n_before = sessions->len;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    g_autofree gchar *filename = NULL;
+    g_autofree gchar *contents = NULL;
+    DeapLogin1Session session;
+    gsize length;
+
+    if (!deap_login1_session_is_state_file (name) ||
+        g_hash_table_contains (session_index, name))
+      continue;
+
+    filename = g_build_filename (path, name, NULL);
+    if (!g_file_get_contents (filename, &contents, &length, NULL))
+      continue;
+
+    if (!deap_login1_session_parse_state (name, contents, length, strings, &session))
+      session.user_name = NULL;
+
+    g_array_append_val (sessions, session);
+    g_hash_table_insert (session_index, (gpointer) session.session_id, GUINT_TO_POINTER (sessions->len));
+  }
+
+  return sessions->len - n_before;
+}
+
+/*
+ * deap_login1_session_object_path
+ *
+ * The login1 Session object of @session_id, escaped like sd-bus does:
+ * every byte other than [A-Za-z0-9], and a leading digit, becomes "_"
+ * and two hex digits.
+ */
+gchar *
+deap_login1_session_object_path (const gchar *session_id)
+{
+  GString *path;
+  const gchar *p;
+
+  g_return_val_if_fail (session_id != NULL, NULL);
+
+  path = g_string_new ("/org/freedesktop/login1/session/");
+
+  if (*session_id == '\0')
+    g_string_append_c (path, '_');
+
+  for (p = session_id; *p != '\0'; p++) {
+    if (g_ascii_isalpha (*p) || (g_ascii_isdigit (*p) && p != session_id))
+      g_string_append_c (path, *p);
+    else
+      g_string_append_printf (path, "_%02x", (guchar) *p);
+  }
+
+  return g_string_free (path, FALSE);
+}
@@ -0,0 +1,66 @@
+/* deap-login1-session.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A row of ListSessions. The object path is not kept: it is
+ * "/org/freedesktop/login1/session/" followed by the escaped session
+ * ID, and nothing needs it after SessionNew has fetched the session
+ * properties.
+ */
+typedef struct
+{
+  /* Interned in the GStringChunk the record was parsed into */
+  const gchar *session_id;
+  const gchar *user_name;
+  const gchar *seat_id;
+  guint32      user_id;
+
+  /* Borrowed, owned by DeapLogin1's session_list */
+  GtkWidget   *row;
+  GtkWidget   *user_id_label;
+  GtkWidget   *user_name_label;
+} DeapLogin1Session;
+
+guint       deap_login1_session_parse_list    (GVariant     *list,
+                                               GArray       *sessions,
+                                               GStringChunk *strings,
+                                               GHashTable   *session_index);
+gchar *     deap_login1_session_get_state_dir (void);
+gboolean    deap_login1_session_parse_state   (const gchar  *session_id,
+                                               const gchar  *contents,
+                                               gsize         length,
+                                               GStringChunk *strings,
+                                               DeapLogin1Session *session);
+guint       deap_login1_session_read_dir      (const gchar  *path,
+                                               GArray       *sessions,
+                                               GStringChunk *strings,
+                                               GHashTable   *session_index,
+                                               GError      **error);
+gboolean    deap_login1_session_is_state_file (const gchar  *name);
+gboolean    deap_login1_session_id_is_valid   (const gchar  *session_id);
+gchar *     deap_login1_session_object_path   (const gchar  *session_id);
+
+G_END_DECLS
@@ -21,236 +21,1241 @@
 #define G_LOG_DOMAIN "DeapLogin1"
 
 #include "deap-config.h"
+#include "deap-bus-manager.h"
+#include "deap-call.h"
+#include "deap-dbus-login1.h"
 #include "deap-debug.h"
 #include "deap-login1.h"
+#include "deap-login1-session.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
 
 #include <gio/gio.h>
+#include <glib/gi18n.h>
+#include <string.h>
 
 struct _DeapLogin1
 {
   GtkBox        parent_instance;
 
   /* org.freedesktop.login1 */
-  GDBusProxy    *login1;
+  DeapDBusLogin1Manager *login1;
   GCancellable  *cancellable;
+  guint          session_new_id;
+  guint          session_removed_id;
 
   /* Widgets */
   GtkWidget     *session_list;
   GtkWidget     *lock_screen;
   GtkWidget     *session_id_entry;
+  GtkWidget     *lock_progress;
+  GtkWidget     *lock_failures;
+
+  /*
+   * DeapLogin1Session records, contiguous. Their strings live in
+   * session_strings, which is replaced (and freed at once) on every
+   * ListSessions, or compacted once it has grown past twice what the
+   * live records hold; session_index maps a session ID to its
+   * position + 1.
+   */
+  GArray        *sessions;
+  GStringChunk  *session_strings;
+  GHashTable    *session_index;
+  gsize          session_strings_size;
+  gsize          session_strings_limit;
+
+  /* The state file backend, see watch_sessions_dir() */
+  gchar         *sessions_dir;
+  GFileMonitor  *sessions_monitor;
+  GHashTable    *dirty_sessions;
+  guint          dirty_source_id;
+
+  /* The LockSession batch in progress, see lock_sessions() */
+  struct _LockBatch *lock_batch;
+
+  /* Trace flows of in-flight D-Bus requests */
+  guint          login1_flow;
+  guint          list_sessions_flow;
+};
 
-  GPtrArray     *sessions;
+enum {
+  SESSION_ADDED,
+  SESSION_CHANGED,
+  SESSION_REMOVED,
+  N_SIGNALS
 };
 
+static guint signals [N_SIGNALS];
+
+G_DEFINE_TYPE (DeapLogin1, deap_login1, GTK_TYPE_BOX)
+
+#define SESSION_STRINGS_CHUNK_SIZE  1024
+#define SESSION_STRINGS_MIN_LIMIT   (4 * SESSION_STRINGS_CHUNK_SIZE)
+
+/*
+ * LockSession calls are pipelined, at most this many in flight: every
+ * reply sends the next one.
+ */
+#define MAX_LOCKS_IN_FLIGHT         8
+#define MAX_LOCK_FAILURES_SHOWN     10
+
+typedef struct _LockBatch
+{
+  GPtrArray    *session_ids;
+  guint         next;
+  guint         in_flight;
+  guint         n_done;
+  guint         n_failed;
+  GString      *failures;
+  guint         flow;
+} LockBatch;
+
 typedef struct
 {
-  gchar *session_id;
-  gchar *user_id;
-  gchar *user_name;
-  gchar *seat_id;
-  gchar *obj_path;
-} Login1Session;
+  LockBatch    *batch;
+  guint         index;
+} LockRequest;
 
-G_DEFINE_TYPE (DeapLogin1, deap_login1, GTK_TYPE_BOX)
 
-#define LOGIN1_SESSION(_ptr)  ((Login1Session*)_ptr)
+/*
+ * intern_session_string
+ *
+ * Counts every string as new, though the pool may already hold it, so
+ * session_strings_size is an upper bound of what the pool has grown by.
+ */
+static const gchar *
+intern_session_string (DeapLogin1  *self,
+                       const gchar *str)
+{
+  if (str == NULL)
+    return NULL;
+
+  self->session_strings_size += strlen (str) + 1;
 
+  return g_string_chunk_insert_const (self->session_strings, str);
+}
 
-static gpointer
-login1_session_new (const gchar *session_id,
-                    guint32      user_id,
-                    const gchar *user_name,
-                    const gchar *seat_id,
-                    const gchar *obj_path)
+/*
+ * set_user_id_label
+ *
+ * A session added from SessionNew, or from a state file without UID
+ * or USER, has no user name until its properties arrive, and its UID
+ * of 0 is a placeholder rather than root's.
+ */
+static void
+set_user_id_label (DeapLogin1Session *session)
 {
-  Login1Session *session;
+  gchar buf[16];
 
-  session = g_new0 (Login1Session, 1);
+  if (session->user_name == NULL) {
+    gtk_label_set_text (GTK_LABEL (session->user_id_label), "…");
+    return;
+  }
 
-  session->session_id = g_strdup (session_id);
-  session->user_id = g_strdup_printf ("%d", user_id);
-  session->user_name = g_strdup (user_name);
-  session->seat_id = g_strdup (seat_id);
-  session->obj_path = g_strdup (obj_path);
+  g_snprintf (buf, sizeof buf, "%u", session->user_id);
+  gtk_label_set_text (GTK_LABEL (session->user_id_label), buf);
+}
+
+static void
+create_session_list_row (DeapLogin1Session *session)
+{
+  GtkWidget *row;
+  GtkWidget *hbox;
+  GtkWidget *session_id;
+  gint64 begin;
+
+  begin = g_get_monotonic_time ();
+
+  row = gtk_list_box_row_new ();
+
+  /* Interned, re-pointed whenever session_strings is replaced */
+  g_object_set_data (G_OBJECT (row), "session-id", (gpointer) session->session_id);
+
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+
+  session_id = gtk_label_new (session->session_id);
+  gtk_box_pack_start (GTK_BOX (hbox), session_id, TRUE, FALSE, 0);
+
+  session->user_id_label = gtk_label_new (NULL);
+  set_user_id_label (session);
+  gtk_box_pack_start (GTK_BOX (hbox), session->user_id_label, TRUE, FALSE, 0);
+
+  session->user_name_label = gtk_label_new (session->user_name);
+  gtk_box_pack_start (GTK_BOX (hbox), session->user_name_label, TRUE, FALSE, 0);
+
+  gtk_container_add (GTK_CONTAINER (row), hbox);
+  gtk_widget_show_all (row);
+
+  session->row = row;
+
+  deap_metrics_histogram_record ("rows.session.build", g_get_monotonic_time () - begin);
+}
+
+/* --- Session Table --- */
+static void
+emit_session_signal (DeapLogin1              *self,
+                     guint                    signal,
+                     const DeapLogin1Session *session)
+{
+  g_signal_emit (self, signals [signal], 0,
+                 session->session_id, session->user_id, session->user_name, session->seat_id);
+}
+
+static gsize
+session_strings_bytes (const DeapLogin1Session *session)
+{
+  return strlen (session->session_id) + 1 +
+         (session->user_name != NULL ? strlen (session->user_name) + 1 : 0) +
+         (session->seat_id != NULL ? strlen (session->seat_id) + 1 : 0);
+}
 
-  return (gpointer) session;
+/* The pool now holds @size bytes for the live records */
+static void
+reset_session_strings_size (DeapLogin1 *self,
+                            gsize       size)
+{
+  self->session_strings_size = size;
+  self->session_strings_limit = MAX (2 * size, SESSION_STRINGS_MIN_LIMIT);
 }
 
+/*
+ * maybe_compact_session_strings
+ *
+ * Between two ListSessions, the state files and SessionNew/Removed
+ * only ever add to session_strings: removed sessions and replaced
+ * names leave their bytes behind. Once the pool may have grown past
+ * twice the live strings, they are interned into a fresh one, and the
+ * index and the rows are pointed at it, for O(1) amortized per change.
+ *
+ * Only called at the end of a table change, with no record or string
+ * of the old pool held further up.
+ */
 static void
-login1_session_free (gpointer user_data)
+maybe_compact_session_strings (DeapLogin1 *self)
 {
-  Login1Session *session;
+  GStringChunk *strings;
+  GHashTable *session_index;
+  gsize size = 0;
+  guint i;
+
+  if (self->session_strings_size <= self->session_strings_limit)
+    return;
+
+  strings = g_string_chunk_new (SESSION_STRINGS_CHUNK_SIZE);
+  session_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < self->sessions->len; i++) {
+    DeapLogin1Session *session = &g_array_index (self->sessions, DeapLogin1Session, i);
+
+    session->session_id = g_string_chunk_insert_const (strings, session->session_id);
+    if (session->user_name != NULL)
+      session->user_name = g_string_chunk_insert_const (strings, session->user_name);
+    if (session->seat_id != NULL)
+      session->seat_id = g_string_chunk_insert_const (strings, session->seat_id);
+
+    g_hash_table_insert (session_index, (gpointer) session->session_id, GUINT_TO_POINTER (i + 1));
+    g_object_set_data (G_OBJECT (session->row), "session-id", (gpointer) session->session_id);
+
+    size += session_strings_bytes (session);
+  }
 
-  g_return_if_fail (user_data != NULL);
+  deap_debug_msg ("Compacted the session strings from at most %" G_GSIZE_FORMAT " to %" G_GSIZE_FORMAT " bytes",
+                  self->session_strings_size, size);
+  deap_metrics_counter_add ("login1.strings.compactions", 1);
 
-  session = LOGIN1_SESSION (user_data);
+  g_hash_table_unref (self->session_index);
+  g_string_chunk_free (self->session_strings);
+  self->session_index = session_index;
+  self->session_strings = strings;
 
-  g_free (session->session_id);
-  g_free (session->user_id);
-  g_free (session->user_name);
-  g_free (session->seat_id);
-  g_free (session->obj_path);
-  g_free (session);
+  reset_session_strings_size (self, size);
 }
 
-static GPtrArray *
-parse_from_serialized_dbus_data (GVariant *resource)
+static DeapLogin1Session *
+lookup_session (DeapLogin1  *self,
+                const gchar *session_id)
 {
-  g_autoptr(GVariantIter) iter = NULL;
-  GPtrArray *ret;
-  gsize len;
+  guint position;
 
-  g_return_val_if_fail (resource != NULL, NULL);
+  position = GPOINTER_TO_UINT (g_hash_table_lookup (self->session_index, session_id));
+  if (position == 0)
+    return NULL;
 
-  g_variant_get (resource, "(a(susso))", &iter);
-  len = g_variant_iter_n_children (iter);
+  return &g_array_index (self->sessions, DeapLogin1Session, position - 1);
+}
 
-  ret = g_ptr_array_new_full (len, login1_session_free);
+/*
+ * patch_session
+ *
+ * Updates the fields (and the labels) of @session which differ from
+ * the given ones. Strings are interned into the current pool.
+ */
+static void
+patch_session (DeapLogin1        *self,
+               DeapLogin1Session *session,
+               guint32            user_id,
+               const gchar       *user_name,
+               const gchar       *seat_id)
+{
+  gboolean changed = FALSE;
+  gboolean was_placeholder = session->user_name == NULL;
 
-  {
-    gchar *session_id;
-    guint32 user_id;
-    gchar *user_name;
-    gchar *seat_id;
-    gchar *obj_path;
+  if (g_strcmp0 (session->user_name, user_name) != 0) {
+    session->user_name = intern_session_string (self, user_name);
+    gtk_label_set_text (GTK_LABEL (session->user_name_label), session->user_name);
+    changed = TRUE;
+  }
 
-    while (g_variant_iter_loop (iter, "(susso)", &session_id, &user_id, &user_name, &seat_id, &obj_path)) {
-      gpointer p;
+  if (session->user_id != user_id || was_placeholder != (session->user_name == NULL)) {
+    session->user_id = user_id;
+    set_user_id_label (session);
+    changed = TRUE;
+  }
 
-      p = login1_session_new (session_id, user_id, user_name, seat_id, obj_path);
-      g_ptr_array_add (ret, p);
-    }
+  if (g_strcmp0 (session->seat_id, seat_id) != 0) {
+    session->seat_id = intern_session_string (self, seat_id);
+    changed = TRUE;
   }
 
-  return ret;
+  if (!changed)
+    return;
+
+  emit_session_signal (self, SESSION_CHANGED, session);
+  maybe_compact_session_strings (self);
 }
 
-static GtkWidget *
-create_session_list_row (gpointer user_data)
+static void
+add_session (DeapLogin1  *self,
+             const gchar *session_id,
+             guint32      user_id,
+             const gchar *user_name,
+             const gchar *seat_id)
 {
-  Login1Session *session;
-  GtkWidget *row;
-  GtkWidget *hbox;
-  GtkWidget *session_id;
-  GtkWidget *user_id;
-  GtkWidget *user_name;
+  DeapLogin1Session session = { NULL, };
 
-  session = LOGIN1_SESSION (user_data);
+  session.session_id = intern_session_string (self, session_id);
+  session.user_name = intern_session_string (self, user_name);
+  session.seat_id = intern_session_string (self, seat_id);
+  session.user_id = user_id;
 
-  row = gtk_list_box_row_new ();
-  g_object_set_data (G_OBJECT (row), "session-id", g_strdup (session->session_id));
+  create_session_list_row (&session);
+  gtk_list_box_insert (GTK_LIST_BOX (self->session_list), session.row, -1);
 
-  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  g_array_append_val (self->sessions, session);
+  g_hash_table_insert (self->session_index,
+                       (gpointer) session.session_id,
+                       GUINT_TO_POINTER (self->sessions->len));
 
-  session_id = gtk_label_new (session->session_id);
-  gtk_box_pack_start (GTK_BOX (hbox), session_id, TRUE, FALSE, 0);
+  emit_session_signal (self, SESSION_ADDED, &session);
+  maybe_compact_session_strings (self);
+}
 
-  user_id = gtk_label_new (session->user_id);
-  gtk_box_pack_start (GTK_BOX (hbox), user_id, TRUE, FALSE, 0);
+/*
+ * remove_session
+ *
+ * The last record is moved into the hole, so only its index entry
+ * needs fixing up. Its strings stay in the pool until the next
+ * ListSessions or compaction.
+ */
+static void
+remove_session (DeapLogin1  *self,
+                const gchar *session_id)
+{
+  DeapLogin1Session *session;
+  guint position;
 
-  user_name = gtk_label_new (session->user_name);
-  gtk_box_pack_start (GTK_BOX (hbox), user_name, TRUE, FALSE, 0);
+  position = GPOINTER_TO_UINT (g_hash_table_lookup (self->session_index, session_id));
+  if (position == 0)
+    return;
 
-  gtk_container_add (GTK_CONTAINER (row), hbox);
-  gtk_widget_show_all (row);
+  session = &g_array_index (self->sessions, DeapLogin1Session, position - 1);
+  emit_session_signal (self, SESSION_REMOVED, session);
+  gtk_widget_destroy (session->row);
+  g_hash_table_remove (self->session_index, session->session_id);
+
+  g_array_remove_index_fast (self->sessions, position - 1);
+
+  if (position - 1 < self->sessions->len) {
+    session = &g_array_index (self->sessions, DeapLogin1Session, position - 1);
+    g_hash_table_insert (self->session_index,
+                         (gpointer) session->session_id,
+                         GUINT_TO_POINTER (position));
+  }
 
-  return row;
+  maybe_compact_session_strings (self);
 }
 
+/*
+ * reconcile_sessions
+ *
+ * Applies a full listing, parsed into a fresh array, string pool and
+ * index which are taken over, as a diff against the table: rows of
+ * vanished sessions are removed, new ones are appended and surviving
+ * ones are carried over and patched in place. The old pool is dropped
+ * in one go.
+ */
 static void
-add_row_to_session_list_func (gpointer data,
-                              gpointer user_data)
+reconcile_sessions (DeapLogin1   *self,
+                    GArray       *sessions,
+                    GStringChunk *strings,
+                    GHashTable   *session_index)
 {
-  DeapLogin1 *self;
-  GtkWidget *row;
+  GStringChunk *old_strings;
+  GHashTable *old_index;
+  GArray *old_sessions;
+  gsize size = 0;
+  guint i;
+
+  old_sessions = self->sessions;
+  old_strings = self->session_strings;
+  old_index = self->session_index;
+
+  self->sessions = sessions;
+  self->session_strings = strings;
+  self->session_index = session_index;
+
+  for (i = 0; i < self->sessions->len; i++) {
+    DeapLogin1Session *session = &g_array_index (self->sessions, DeapLogin1Session, i);
+    DeapLogin1Session *old;
+    guint position;
+
+    size += session_strings_bytes (session);
+    position = GPOINTER_TO_UINT (g_hash_table_lookup (old_index, session->session_id));
+
+    if (position == 0) {
+      create_session_list_row (session);
+      gtk_list_box_insert (GTK_LIST_BOX (self->session_list), session->row, -1);
+      emit_session_signal (self, SESSION_ADDED, session);
+      continue;
+    }
 
-  self = DEAP_LOGIN1 (user_data);
-  row = create_session_list_row (data);
+    /* Carry the row over, pointing it at the new pool */
+    old = &g_array_index (old_sessions, DeapLogin1Session, position - 1);
+    session->row = old->row;
+    session->user_id_label = old->user_id_label;
+    session->user_name_label = old->user_name_label;
+    g_object_set_data (G_OBJECT (session->row), "session-id", (gpointer) session->session_id);
+    old->row = NULL;
+
+    if (session->user_id != old->user_id ||
+        (session->user_name == NULL) != (old->user_name == NULL))
+      set_user_id_label (session);
+
+    if (g_strcmp0 (session->user_name, old->user_name) != 0)
+      gtk_label_set_text (GTK_LABEL (session->user_name_label), session->user_name);
+
+    if (session->user_id != old->user_id ||
+        g_strcmp0 (session->user_name, old->user_name) != 0 ||
+        g_strcmp0 (session->seat_id, old->seat_id) != 0)
+      emit_session_signal (self, SESSION_CHANGED, session);
+  }
+
+  /* Whatever was not carried over is gone */
+  for (i = 0; i < old_sessions->len; i++) {
+    DeapLogin1Session *old = &g_array_index (old_sessions, DeapLogin1Session, i);
 
-  gtk_list_box_insert (GTK_LIST_BOX (self->session_list), row, -1);
+    if (old->row != NULL) {
+      deap_debug_msg ("Session %s is gone", old->session_id);
+      emit_session_signal (self, SESSION_REMOVED, old);
+      gtk_widget_destroy (old->row);
+    }
+  }
+
+  g_hash_table_unref (old_index);
+  g_array_unref (old_sessions);
+  g_string_chunk_free (old_strings);
+
+  reset_session_strings_size (self, size);
 }
+/* --- End of Session Table --- */
 
 static void
 get_session_list_finish (GObject      *source,
                          GAsyncResult *res,
                          gpointer      user_data)
 {
-  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+  DeapCall *call = user_data;
+  DeapLogin1 *self = deap_call_get_owner (call);
   g_autoptr(GVariant) ret = NULL;
   g_autoptr(GError) error = NULL;
+  GStringChunk *strings;
+  GHashTable *session_index;
+  GArray *sessions;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_dbus_login1_manager_call_list_sessions_finish (DEAP_DBUS_LOGIN1_MANAGER (source),
+                                                      &ret,
+                                                      res,
+                                                      &error);
+  if (!deap_call_complete (call, &error))
+    return;
+
+  deap_trace_flow_end (self->list_sessions_flow, "ListSessions");
+  self->list_sessions_flow = 0;
 
-  ret = g_dbus_proxy_call_finish (self->login1,
-                                  res,
-                                  &error);
   if (error) {
     deap_warn_msg ("Error org.freedesktop.login1.Manager.ListSessions: %s", error->message);
+    deap_profile_page_populated ("freedesktop-login1");
     return;
   }
 
-  self->sessions = parse_from_serialized_dbus_data (ret);
-  g_ptr_array_foreach (self->sessions, add_row_to_session_list_func, self);
+  sessions = g_array_sized_new (FALSE, TRUE, sizeof (DeapLogin1Session), g_variant_n_children (ret));
+  strings = g_string_chunk_new (SESSION_STRINGS_CHUNK_SIZE);
+  session_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  deap_login1_session_parse_list (ret, sessions, strings, session_index);
+  reconcile_sessions (self, sessions, strings, session_index);
+
+  deap_profile_page_populated ("freedesktop-login1");
 }
 
 static void
 get_session_list (DeapLogin1 *self)
 {
-  g_dbus_proxy_call (self->login1,
-                     "ListSessions",
-                     NULL,
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     (GAsyncReadyCallback) get_session_list_finish,
-                     self);
+  DeapCall *call;
+
+  self->list_sessions_flow = deap_trace_flow_begin ("ListSessions");
+
+  call = deap_call_new ("org.freedesktop.login1.Manager.ListSessions", DEAP_CALL_LISTING, self, self->cancellable);
+  deap_dbus_login1_manager_call_list_sessions (self->login1,
+                                               deap_call_get_cancellable (call),
+                                               get_session_list_finish,
+                                               call);
+}
+
+static void
+get_session_properties_finish (GObject      *source,
+                               GAsyncResult *res,
+                               gpointer      user_data)
+{
+  DeapCall *call = user_data;
+  DeapLogin1 *self = deap_call_get_owner (call);
+  g_autoptr(GVariant) ret = NULL;
+  g_autoptr(GVariant) props = NULL;
+  g_autoptr(GError) error = NULL;
+  const gchar *session_id = NULL;
+  const gchar *user_name = NULL;
+  const gchar *seat_id = NULL;
+  guint32 user_id = 0;
+  DeapLogin1Session *session;
+
+  ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+  if (!deap_call_complete (call, &error))
+    return;
+
+  if (error) {
+    deap_warn_msg ("Error org.freedesktop.login1.Session GetAll: %s", error->message);
+    return;
+  }
+
+  g_variant_get (ret, "(@a{sv})", &props);
+  g_variant_lookup (props, "Id", "&s", &session_id);
+  g_variant_lookup (props, "User", "(u&o)", &user_id, NULL);
+  g_variant_lookup (props, "Name", "&s", &user_name);
+  g_variant_lookup (props, "Seat", "(&s&o)", &seat_id, NULL);
+
+  /* Removed again before the reply made it */
+  if (session_id == NULL ||
+      (session = lookup_session (self, session_id)) == NULL)
+    return;
+
+  patch_session (self, session, user_id, user_name, seat_id);
+}
+
+/*
+ * request_session_properties
+ *
+ * Fetches the details of a session whose row was added without them,
+ * to be patched in by get_session_properties_finish().
+ */
+static void
+request_session_properties (DeapLogin1  *self,
+                            const gchar *object_path)
+{
+  DeapCall *call;
+
+  if (self->login1 == NULL)
+    return;
+
+  call = deap_call_new ("org.freedesktop.DBus.Properties.GetAll(login1.Session)", DEAP_CALL_PROPERTY, self, self->cancellable);
+  g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (self->login1)),
+                          "org.freedesktop.login1",
+                          object_path,
+                          "org.freedesktop.DBus.Properties",
+                          "GetAll",
+                          g_variant_new ("(s)", "org.freedesktop.login1.Session"),
+                          G_VARIANT_TYPE ("(a{sv})"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          deap_call_get_cancellable (call),
+                          get_session_properties_finish,
+                          call);
+}
+
+
+/* --- State Files --- */
+static void
+request_missing_session_details (DeapLogin1 *self)
+{
+  guint i;
+
+  for (i = 0; i < self->sessions->len; i++) {
+    DeapLogin1Session *session = &g_array_index (self->sessions, DeapLogin1Session, i);
+    g_autofree gchar *object_path = NULL;
+
+    if (session->user_name != NULL)
+      continue;
+
+    object_path = deap_login1_session_object_path (session->session_id);
+    request_session_properties (self, object_path);
+  }
+}
+
+static gboolean
+read_sessions_dir (DeapLogin1  *self,
+                   GError     **error)
+{
+  GStringChunk *strings;
+  GHashTable *session_index;
+  GArray *sessions;
+
+  sessions = g_array_new (FALSE, TRUE, sizeof (DeapLogin1Session));
+  strings = g_string_chunk_new (SESSION_STRINGS_CHUNK_SIZE);
+  session_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  deap_login1_session_read_dir (self->sessions_dir, sessions, strings, session_index, error);
+  if (error != NULL && *error != NULL) {
+    g_hash_table_unref (session_index);
+    g_array_unref (sessions);
+    g_string_chunk_free (strings);
+    return FALSE;
+  }
+
+  reconcile_sessions (self, sessions, strings, session_index);
+  request_missing_session_details (self);
+
+  return TRUE;
+}
+
+/*
+ * refresh_session
+ *
+ * Re-reads the state file of @session_id: a gone file removes the
+ * session, an existing one patches or adds it. @scratch holds the
+ * parsed strings only until they are interned into the table's pool.
+ */
+static void
+refresh_session (DeapLogin1   *self,
+                 const gchar  *session_id,
+                 GStringChunk *scratch)
+{
+  g_autofree gchar *filename = NULL;
+  g_autofree gchar *contents = NULL;
+  DeapLogin1Session parsed;
+  DeapLogin1Session *session;
+  gboolean complete;
+  gsize length;
+
+  filename = g_build_filename (self->sessions_dir, session_id, NULL);
+
+  if (!g_file_get_contents (filename, &contents, &length, NULL)) {
+    remove_session (self, session_id);
+    return;
+  }
+
+  complete = deap_login1_session_parse_state (session_id, contents, length, scratch, &parsed);
+  session = lookup_session (self, session_id);
+
+  if (session != NULL) {
+    if (complete)
+      patch_session (self, session, parsed.user_id, parsed.user_name, parsed.seat_id);
+  } else if (complete) {
+    add_session (self, session_id, parsed.user_id, parsed.user_name, parsed.seat_id);
+  } else {
+    g_autofree gchar *object_path = deap_login1_session_object_path (session_id);
+
+    add_session (self, session_id, 0, NULL, NULL);
+    request_session_properties (self, object_path);
+  }
+}
+
+static gboolean
+refresh_dirty_sessions_cb (gpointer user_data)
+{
+  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+  GStringChunk *scratch;
+  GHashTableIter iter;
+  gpointer session_id;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  self->dirty_source_id = 0;
+
+  scratch = g_string_chunk_new (SESSION_STRINGS_CHUNK_SIZE);
+
+  g_hash_table_iter_init (&iter, self->dirty_sessions);
+  while (g_hash_table_iter_next (&iter, &session_id, NULL))
+    refresh_session (self, session_id, scratch);
+
+  deap_metrics_counter_add ("login1.files.refreshes", g_hash_table_size (self->dirty_sessions));
+  g_hash_table_remove_all (self->dirty_sessions);
+  g_string_chunk_free (scratch);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+mark_session_dirty (DeapLogin1 *self,
+                    GFile      *file)
+{
+  gchar *name;
+
+  if (file == NULL)
+    return;
+
+  name = g_file_get_basename (file);
+  if (!deap_login1_session_is_state_file (name)) {
+    g_free (name);
+    return;
+  }
+
+  g_hash_table_add (self->dirty_sessions, name);
+
+  if (self->dirty_source_id == 0)
+    self->dirty_source_id = g_idle_add (refresh_dirty_sessions_cb, self);
+}
+
+/*
+ * on_sessions_dir_changed
+ *
+ * logind writes a state file to a temporary and renames it into
+ * place, so a session shows up as RENAMED (or CREATED, depending on the
+ * monitor), is updated the same way and goes with DELETED. Events are
+ * coalesced per session until the main loop is idle.
+ */
+static void
+on_sessions_dir_changed (GFileMonitor      *monitor,
+                         GFile             *file,
+                         GFile             *other_file,
+                         GFileMonitorEvent  event,
+                         gpointer           user_data)
+{
+  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+
+  switch (event) {
+  case G_FILE_MONITOR_EVENT_RENAMED:
+    mark_session_dirty (self, file);
+    mark_session_dirty (self, other_file);
+    break;
+
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_DELETED:
+  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+  case G_FILE_MONITOR_EVENT_MOVED_IN:
+  case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    mark_session_dirty (self, file);
+    break;
+
+  default:
+    break;
+  }
+}
+
+/*
+ * watch_sessions_dir
+ *
+ * With DEAP_LOGIN1_BACKEND=files, sessions are read from logind's state
+ * files in /run/systemd/sessions, below DEAP_SYSTEMD_ROOT if set, and
+ * kept up to date through a GFileMonitor (inotify) on it, instead of
+ * ListSessions and the Manager signals. The bus is still used for
+ * LockSession and for a session whose file lacks its details.
+ *
+ * Returns: FALSE if the directory cannot be watched or read, in which
+ * case sessions come from the bus as usual
+ */
+static gboolean
+watch_sessions_dir (DeapLogin1 *self)
+{
+  g_autoptr(GFile) dir = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (g_strcmp0 (g_getenv ("DEAP_LOGIN1_BACKEND"), "files") != 0)
+    return FALSE;
+
+  self->sessions_dir = deap_login1_session_get_state_dir ();
+
+  /* Watched first, so nothing is missed between the scan and the watch */
+  dir = g_file_new_for_path (self->sessions_dir);
+  self->sessions_monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_WATCH_MOVES, NULL, &error);
+  if (self->sessions_monitor == NULL) {
+    deap_warn_msg ("Could not watch %s, listing sessions over D-Bus: %s", self->sessions_dir, error->message);
+    g_clear_pointer (&self->sessions_dir, g_free);
+    return FALSE;
+  }
+
+  g_signal_connect (self->sessions_monitor, "changed", G_CALLBACK (on_sessions_dir_changed), self);
+
+  if (!read_sessions_dir (self, &error)) {
+    deap_warn_msg ("Could not read %s, listing sessions over D-Bus: %s", self->sessions_dir, error->message);
+    g_signal_handlers_disconnect_by_data (self->sessions_monitor, self);
+    g_file_monitor_cancel (self->sessions_monitor);
+    g_clear_object (&self->sessions_monitor);
+    g_clear_pointer (&self->sessions_dir, g_free);
+    return FALSE;
+  }
+
+  deap_info_msg ("Reading sessions from %s", self->sessions_dir);
+  deap_profile_page_populated ("freedesktop-login1");
+
+  return TRUE;
 }
+/* --- End of State Files --- */
 
+/*
+ * on_login1_signal
+ *
+ * org.freedesktop.login1.Manager
+ *
+ * Signal: SessionNew (s session_id, o object_path)
+ * Signal: SessionRemoved (s session_id, o object_path)
+ *
+ * SessionNew carries no user details, so the row is inserted right away
+ * and patched once the session object's properties arrive.
+ */
+static void
+on_login1_signal (GDBusConnection *connection,
+                  const gchar     *sender_name,
+                  const gchar     *object_path,
+                  const gchar     *interface_name,
+                  const gchar     *signal_name,
+                  GVariant        *parameters,
+                  gpointer         user_data)
+{
+  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+  const gchar *session_id;
+  const gchar *obj_path;
+
+  if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(so)")))
+    return;
+
+  g_variant_get (parameters, "(&s&o)", &session_id, &obj_path);
+
+  if (g_strcmp0 (signal_name, "SessionNew") == 0) {
+    deap_debug_msg ("SessionNew: %s", session_id);
+
+    if (lookup_session (self, session_id) == NULL)
+      add_session (self, session_id, 0, NULL, NULL);
+
+    request_session_properties (self, obj_path);
+  } else if (g_strcmp0 (signal_name, "SessionRemoved") == 0) {
+    deap_debug_msg ("SessionRemoved: %s", session_id);
+    remove_session (self, session_id);
+  }
+}
+
+static guint
+subscribe_login1_signal (DeapLogin1  *self,
+                         const gchar *signal_name)
+{
+  return g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (G_DBUS_PROXY (self->login1)),
+                                             "org.freedesktop.login1",
+                                             "org.freedesktop.login1.Manager",
+                                             signal_name,
+                                             "/org/freedesktop/login1",
+                                             NULL,
+                                             G_DBUS_SIGNAL_FLAGS_NONE,
+                                             on_login1_signal,
+                                             self,
+                                             NULL);
+}
+
+static void
+unsubscribe_login1_signals (DeapLogin1 *self)
+{
+  GDBusConnection *connection;
+
+  if (self->login1 == NULL)
+    return;
+
+  connection = g_dbus_proxy_get_connection (G_DBUS_PROXY (self->login1));
+
+  if (self->session_new_id) {
+    g_dbus_connection_signal_unsubscribe (connection, self->session_new_id);
+    self->session_new_id = 0;
+  }
+
+  if (self->session_removed_id) {
+    g_dbus_connection_signal_unsubscribe (connection, self->session_removed_id);
+    self->session_removed_id = 0;
+  }
+}
+
+/*
+ * login1_proxy_acquired_cb
+ *
+ * Also runs when logind got a new owner (or the system bus came back):
+ * the signals missed in between are made up for by re-listing, which is
+ * reconciled against the rows already shown.
+ */
 static void
 login1_proxy_acquired_cb (GObject      *source,
                           GAsyncResult *res,
                           gpointer      user_data)
 {
-  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+  DeapLogin1 *self;
+  g_autoptr(GObject) proxy = NULL;
   g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
 
-  self->login1 = g_dbus_proxy_new_for_bus_finish (res, &error);
+  proxy = deap_bus_manager_get_proxy_finish (DEAP_BUS_MANAGER (source), res, &error);
 
-  if (error)
+  /* Disposed */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = DEAP_LOGIN1 (user_data);
+
+  deap_trace_flow_end (self->login1_flow, "org.freedesktop.login1 proxy");
+  self->login1_flow = 0;
+
+  if (error) {
     deap_warn_msg ("Error acquiring org.freedesktop.login1: %s", error->message);
-  else {
+    deap_profile_page_populated ("freedesktop-login1");
+  } else {
     deap_info_msg ("org.freedesktop.login1 successfully acquired");
+
+    unsubscribe_login1_signals (self);
+    g_set_object (&self->login1, proxy);
+
+    /* Sessions come from the state files, only their gaps from here */
+    if (self->sessions_monitor != NULL) {
+      request_missing_session_details (self);
+      return;
+    }
+
+    /*
+     * The Manager emits plenty of signals (seats, users, sleep, ...);
+     * subscribing per member keeps the bus from routing the rest here.
+     */
+    self->session_new_id = subscribe_login1_signal (self, "SessionNew");
+    self->session_removed_id = subscribe_login1_signal (self, "SessionRemoved");
     get_session_list (self);
   }
 }
 
+static void
+acquire_login1_proxy (DeapLogin1 *self)
+{
+  self->login1_flow = deap_trace_flow_begin ("org.freedesktop.login1 proxy");
+  deap_bus_manager_get_proxy_async (deap_bus_manager_get_default (),
+                                    G_BUS_TYPE_SYSTEM,
+                                    DEAP_DBUS_TYPE_LOGIN1_MANAGER_PROXY,
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                    "org.freedesktop.login1",
+                                    "/org/freedesktop/login1",
+                                    "org.freedesktop.login1.Manager",
+                                    self->cancellable,
+                                    login1_proxy_acquired_cb,
+                                    self);
+}
+
+static void
+on_login1_appeared (DeapBusManager *manager,
+                    GBusType        bus_type,
+                    const gchar    *name,
+                    gpointer        user_data)
+{
+  DeapLogin1 *self = DEAP_LOGIN1 (user_data);
+
+  if (bus_type != G_BUS_TYPE_SYSTEM)
+    return;
+
+  deap_info_msg ("org.freedesktop.login1 reappeared, re-listing sessions");
+  acquire_login1_proxy (self);
+}
+
 static void
 register_gdbus_proxies (DeapLogin1 *self)
 {
   g_return_if_fail (self != NULL);
 
+  g_signal_connect_object (deap_bus_manager_get_default (),
+                           "name-appeared::org.freedesktop.login1",
+                           G_CALLBACK (on_login1_appeared),
+                           self,
+                           0);
+
   self->cancellable = g_cancellable_new ();
-  g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            NULL, /* GDBusInterfaceInfo */
-                            "org.freedesktop.login1",
-                            "/org/freedesktop/login1",
-                            "org.freedesktop.login1.Manager",
-                            self->cancellable,
-                            login1_proxy_acquired_cb,
-                            self);
+
+  /* The proxy is wanted either way, for LockSession */
+  watch_sessions_dir (self);
+  acquire_login1_proxy (self);
 }
 
+/* --- Bulk Lock --- */
+static void
+lock_batch_free (LockBatch *batch)
+{
+  g_ptr_array_unref (batch->session_ids);
+  g_string_free (batch->failures, TRUE);
+  g_free (batch);
+}
+
+static void
+update_lock_progress (DeapLogin1 *self)
+{
+  LockBatch *batch = self->lock_batch;
+  g_autofree gchar *text = NULL;
+
+  if (batch->n_failed > 0)
+    text = g_strdup_printf (_("Locked %u of %u, %u failed"),
+                            batch->n_done - batch->n_failed, batch->session_ids->len, batch->n_failed);
+  else
+    text = g_strdup_printf (_("Locked %u of %u"), batch->n_done, batch->session_ids->len);
+
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (self->lock_progress), text);
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (self->lock_progress),
+                                 (gdouble) batch->n_done / batch->session_ids->len);
+
+  if (batch->n_failed > 0) {
+    g_autofree gchar *failures = NULL;
+
+    if (batch->n_failed > MAX_LOCK_FAILURES_SHOWN)
+      failures = g_strdup_printf (_("%s\nand %u more"), batch->failures->str,
+                                  batch->n_failed - MAX_LOCK_FAILURES_SHOWN);
+    else
+      failures = g_strdup (batch->failures->str);
+
+    gtk_label_set_text (GTK_LABEL (self->lock_failures), failures);
+    gtk_widget_show (self->lock_failures);
+  }
+}
+
+static void
+record_lock_failure (LockBatch    *batch,
+                     const gchar  *session_id,
+                     const GError *error)
+{
+  g_autofree gchar *message = g_dbus_error_is_remote_error (error)
+                              ? g_dbus_error_get_remote_error (error) : NULL;
+
+  deap_warn_msg ("Error org.freedesktop.login1.Manager.LockSession(%s): %s", session_id, error->message);
+
+  batch->n_failed++;
+  if (batch->n_failed > MAX_LOCK_FAILURES_SHOWN)
+    return;
+
+  if (batch->failures->len > 0)
+    g_string_append_c (batch->failures, '\n');
+
+  /* The D-Bus error name says it more briefly than the message */
+  g_string_append_printf (batch->failures, "%s: %s", session_id,
+                          message != NULL ? message : error->message);
+}
+
+static void
+finish_lock_batch (DeapLogin1 *self)
+{
+  LockBatch *batch = self->lock_batch;
+
+  deap_trace_flow_end (batch->flow, "LockSession");
+  deap_info_msg ("Locked %u of %u sessions", batch->n_done - batch->n_failed, batch->session_ids->len);
+
+  self->lock_batch = NULL;
+  lock_batch_free (batch);
+
+  gtk_widget_set_sensitive (self->lock_screen, TRUE);
+}
+
+static void send_locks (DeapLogin1 *self);
+
+static void
+lock_session_finish (GObject      *source,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+  DeapCall *call = user_data;
+  DeapLogin1 *self = deap_call_get_owner (call);
+  LockRequest *request = deap_call_get_data (call);
+  LockBatch *batch = request->batch;
+  g_autoptr(GError) error = NULL;
+  gboolean owner_alive;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_dbus_login1_manager_call_lock_session_finish (DEAP_DBUS_LOGIN1_MANAGER (source), res, &error);
+  owner_alive = deap_call_complete (call, &error);
+
+  batch->in_flight--;
+
+  /* Orphaned on dispose, freed by its last reply */
+  if (!owner_alive) {
+    if (batch->in_flight == 0)
+      lock_batch_free (batch);
+    g_free (request);
+    return;
+  }
+
+  batch->n_done++;
+  if (error)
+    record_lock_failure (batch, g_ptr_array_index (batch->session_ids, request->index), error);
+
+  g_free (request);
+
+  update_lock_progress (self);
+  send_locks (self);
+
+  if (batch->in_flight == 0)
+    finish_lock_batch (self);
+}
+
+static void
+send_locks (DeapLogin1 *self)
+{
+  LockBatch *batch = self->lock_batch;
+
+  while (batch->in_flight < MAX_LOCKS_IN_FLIGHT && batch->next < batch->session_ids->len) {
+    LockRequest *request;
+    DeapCall *call;
+
+    request = g_new0 (LockRequest, 1);
+    request->batch = batch;
+    request->index = batch->next++;
+
+    call = deap_call_new ("org.freedesktop.login1.Manager.LockSession", DEAP_CALL_ACTION, self, self->cancellable);
+    deap_call_set_data (call, request);
+    batch->in_flight++;
+
+    deap_dbus_login1_manager_call_lock_session (self->login1,
+                                                g_ptr_array_index (batch->session_ids, request->index),
+                                                deap_call_get_cancellable (call),
+                                                lock_session_finish,
+                                                call);
+  }
+}
+
+static void
+lock_all_sessions_finish (GObject      *source,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  DeapCall *call = user_data;
+  DeapLogin1 *self = deap_call_get_owner (call);
+  LockBatch *batch = deap_call_get_data (call);
+  g_autoptr(GError) error = NULL;
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  deap_dbus_login1_manager_call_lock_sessions_finish (DEAP_DBUS_LOGIN1_MANAGER (source), res, &error);
+  if (!deap_call_complete (call, &error)) {
+    lock_batch_free (batch);
+    return;
+  }
+
+  batch->in_flight = 0;
+  batch->n_done = batch->session_ids->len;
+
+  if (error) {
+    /* One call, so it failed for every session alike */
+    record_lock_failure (batch, _("All sessions"), error);
+    batch->n_failed = batch->session_ids->len;
+  }
+
+  update_lock_progress (self);
+  finish_lock_batch (self);
+}
+
+/*
+ * lock_sessions
+ *
+ * Locks every session of @session_ids, taking them over, without
+ * waiting: progress and failures show up under the button as replies
+ * come in. The first @n_invalid are not session IDs, and fail at once
+ * without a call. When the rest is every known session, a single
+ * LockSessions does it.
+ */
+static void
+lock_sessions (DeapLogin1 *self,
+               GPtrArray  *session_ids,
+               guint       n_invalid)
+{
+  LockBatch *batch;
+  gboolean all = FALSE;
+  guint i;
+
+  g_return_if_fail (self->lock_batch == NULL);
+  g_return_if_fail (n_invalid <= session_ids->len);
+
+  if (n_invalid == 0 && session_ids->len > 1 && session_ids->len == self->sessions->len) {
+    all = TRUE;
+    for (i = 0; all && i < session_ids->len; i++)
+      all = lookup_session (self, g_ptr_array_index (session_ids, i)) != NULL;
+  }
+
+  batch = g_new0 (LockBatch, 1);
+  batch->session_ids = session_ids;
+  batch->failures = g_string_new (NULL);
+  batch->flow = deap_trace_flow_begin ("LockSession");
+  self->lock_batch = batch;
+
+  gtk_widget_set_sensitive (self->lock_screen, FALSE);
+  gtk_label_set_text (GTK_LABEL (self->lock_failures), NULL);
+  gtk_widget_hide (self->lock_failures);
+  gtk_widget_show (self->lock_progress);
+
+  for (i = 0; i < n_invalid; i++) {
+    g_autoptr(GError) error = NULL;
+
+    error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, _("Not a session ID"));
+    record_lock_failure (batch, g_ptr_array_index (session_ids, i), error);
+  }
+
+  batch->next = n_invalid;
+  batch->n_done = n_invalid;
+  update_lock_progress (self);
+
+  if (all) {
+    DeapCall *call;
+
+    call = deap_call_new ("org.freedesktop.login1.Manager.LockSessions", DEAP_CALL_ACTION, self, self->cancellable);
+    deap_call_set_data (call, batch);
+    batch->in_flight = 1;
+    deap_dbus_login1_manager_call_lock_sessions (self->login1,
+                                                 deap_call_get_cancellable (call),
+                                                 lock_all_sessions_finish,
+                                                 call);
+    return;
+  }
+
+  send_locks (self);
+
+  /* Nothing valid to send */
+  if (batch->in_flight == 0)
+    finish_lock_batch (self);
+}
+/* --- End of Bulk Lock --- */
+
+
 /* --- Callbacks for Widgets --- */
 static void
-on_session_list_row_selected_cb (GtkListBox    *box,
-                                 GtkListBoxRow *row,
-                                 gpointer       user_data)
+on_session_list_selected_rows_changed_cb (GtkListBox *box,
+                                          gpointer    user_data)
 {
   DeapLogin1 *self = DEAP_LOGIN1 (user_data);
-  const gchar *session_id = NULL;
+  g_autoptr(GString) session_ids = g_string_new (NULL);
+  GList *rows;
+  GList *l;
 
-  session_id = g_object_get_data (G_OBJECT (row), "session-id");
+  /* Also runs as selected rows go away with their sessions */
+  rows = gtk_list_box_get_selected_rows (box);
 
-  gtk_entry_set_text (GTK_ENTRY (self->session_id_entry), session_id);
+  for (l = rows; l != NULL; l = l->next) {
+    if (session_ids->len > 0)
+      g_string_append_c (session_ids, ' ');
+    g_string_append (session_ids, g_object_get_data (G_OBJECT (l->data), "session-id"));
+  }
+
+  g_list_free (rows);
+
+  gtk_entry_set_text (GTK_ENTRY (self->session_id_entry), session_ids->str);
 }
 
 static void
@@ -258,31 +1263,41 @@ execute_lock_screen_cb (GtkWidget *button,
                         gpointer   user_data)
 {
   DeapLogin1 *self = DEAP_LOGIN1 (user_data);
-  const gchar *session_id;
-  const gchar *p;
+  g_auto(GStrv) tokens = NULL;
+  g_autoptr(GHashTable) seen = NULL;
+  GPtrArray *session_ids;
+  guint n_invalid = 0;
+  guint i;
 
-  session_id = gtk_entry_get_text (GTK_ENTRY (self->session_id_entry));
-  if (*session_id == '\0') {
-    deap_warn_msg ("Session ID entry is empty");
+  if (self->login1 == NULL || self->lock_batch != NULL)
     return;
-  }
 
-  /* Does it have any alphabets? if so, just return */
-  for (p = session_id; *p != '\0'; p++) {
-    if (!g_ascii_isdigit (*p)) {
-      deap_warn_msg ("Only numbers are allowed");
-      return;
+  /* Space or comma separated, as filled in from the selection */
+  tokens = g_strsplit_set (gtk_entry_get_text (GTK_ENTRY (self->session_id_entry)), " ,\t", -1);
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  session_ids = g_ptr_array_new_with_free_func (g_free);
+
+  /* A malformed ID fails on its own rather than the whole batch */
+  for (i = 0; tokens[i] != NULL; i++) {
+    if (*tokens[i] == '\0' || !g_hash_table_add (seen, tokens[i]))
+      continue;
+
+    if (lookup_session (self, tokens[i]) != NULL ||
+        deap_login1_session_id_is_valid (tokens[i])) {
+      g_ptr_array_add (session_ids, g_strdup (tokens[i]));
+    } else {
+      deap_debug_msg ("Not a session ID: %s", tokens[i]);
+      g_ptr_array_insert (session_ids, n_invalid++, g_strdup (tokens[i]));
     }
   }
 
-  g_dbus_proxy_call (self->login1,
-                     "LockSession",
-                     g_variant_new ("(s)", session_id),
-                     G_DBUS_CALL_FLAGS_NONE,
-                     -1,
-                     NULL,
-                     NULL,
-                     self);
+  if (session_ids->len == 0) {
+    deap_warn_msg ("Session ID entry is empty");
+    g_ptr_array_unref (session_ids);
+    return;
+  }
+
+  lock_sessions (self, session_ids, n_invalid);
 }
 /* --- End of Callbacks --- */
 
@@ -291,6 +1306,27 @@ execute_lock_screen_cb (GtkWidget *button,
 static void
 deap_login1_dispose (GObject *object)
 {
+  DeapLogin1 *self = DEAP_LOGIN1 (object);
+
+  unsubscribe_login1_signals (self);
+
+  /* Left to the replies in flight, cancelled below */
+  self->lock_batch = NULL;
+
+  if (self->sessions_monitor != NULL) {
+    g_signal_handlers_disconnect_by_data (self->sessions_monitor, self);
+    g_file_monitor_cancel (self->sessions_monitor);
+  }
+
+  if (self->dirty_source_id) {
+    g_source_remove (self->dirty_source_id);
+    self->dirty_source_id = 0;
+  }
+
+  /* In-flight calls and proxy requests must not call back into us */
+  if (self->cancellable)
+    g_cancellable_cancel (self->cancellable);
+
   G_OBJECT_CLASS (deap_login1_parent_class)->dispose (object);
 }
 
@@ -299,12 +1335,16 @@ deap_login1_finalize (GObject *object)
 {
   DeapLogin1 *self = DEAP_LOGIN1 (object);
 
-  if (self->cancellable) {
-    g_cancellable_cancel (self->cancellable);
-    self->login1 = NULL;
-  }
+  g_clear_object (&self->cancellable);
 
   g_clear_object (&self->login1);
+  g_clear_pointer (&self->session_index, g_hash_table_unref);
+  g_clear_pointer (&self->sessions, g_array_unref);
+  g_clear_pointer (&self->session_strings, g_string_chunk_free);
+
+  g_clear_object (&self->sessions_monitor);
+  g_clear_pointer (&self->dirty_sessions, g_hash_table_unref);
+  g_free (self->sessions_dir);
 
   G_OBJECT_CLASS (deap_login1_parent_class)->finalize (object);
 }
@@ -323,15 +1363,54 @@ deap_login1_class_init (DeapLogin1Class *klass)
   gtk_widget_class_bind_template_child (widget_class, DeapLogin1, session_list);
   gtk_widget_class_bind_template_child (widget_class, DeapLogin1, lock_screen);
   gtk_widget_class_bind_template_child (widget_class, DeapLogin1, session_id_entry);
+  gtk_widget_class_bind_template_child (widget_class, DeapLogin1, lock_progress);
+  gtk_widget_class_bind_template_child (widget_class, DeapLogin1, lock_failures);
   gtk_widget_class_bind_template_callback (widget_class, execute_lock_screen_cb);
-  gtk_widget_class_bind_template_callback (widget_class, on_session_list_row_selected_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_session_list_selected_rows_changed_cb);
+
+  /*
+   * DeapLogin1::session-added:
+   * DeapLogin1::session-changed:
+   * DeapLogin1::session-removed:
+   *
+   * A session row was added, had its details patched or was removed.
+   * The strings are only valid during the emission.
+   */
+  signals [SESSION_ADDED] =
+    g_signal_new ("session-added",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+
+  signals [SESSION_CHANGED] =
+    g_signal_new ("session-changed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+
+  signals [SESSION_REMOVED] =
+    g_signal_new ("session-removed",
+                  G_TYPE_FROM_CLASS (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, NULL,
+                  G_TYPE_NONE, 4, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
 }
 
 static void
 deap_login1_init (DeapLogin1 *self)
 {
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->sessions = g_array_new (FALSE, TRUE, sizeof (DeapLogin1Session));
+  self->session_strings = g_string_chunk_new (SESSION_STRINGS_CHUNK_SIZE);
+  self->session_index = g_hash_table_new (g_str_hash, g_str_equal);
+  reset_session_strings_size (self, 0);
+  self->dirty_sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
   register_gdbus_proxies (self);
 }
 
@@ -353,3 +1432,52 @@ deap_login1_get_instance (void)
 
   return instance;
 }
+
+/*
+ * deap_login1_foreach_session
+ *
+ * Calls @func for every session shown, with the arguments of
+ * DeapLogin1::session-added.
+ */
+void
+deap_login1_foreach_session (DeapLogin1            *self,
+                             DeapLogin1SessionFunc  func,
+                             gpointer               user_data)
+{
+  guint i;
+
+  g_return_if_fail (DEAP_IS_LOGIN1 (self));
+  g_return_if_fail (func != NULL);
+
+  for (i = 0; i < self->sessions->len; i++) {
+    const DeapLogin1Session *session = &g_array_index (self->sessions, DeapLogin1Session, i);
+
+    func (self, session->session_id, session->user_id, session->user_name, session->seat_id, user_data);
+  }
+}
+
+/*
+ * deap_login1_select_session
+ *
+ * Selects and focuses the row of @session_id, which fills the session
+ * entry. Returns: FALSE if there is no such session.
+ */
+gboolean
+deap_login1_select_session (DeapLogin1  *self,
+                            const gchar *session_id)
+{
+  DeapLogin1Session *session;
+
+  g_return_val_if_fail (DEAP_IS_LOGIN1 (self), FALSE);
+  g_return_val_if_fail (session_id != NULL, FALSE);
+
+  session = lookup_session (self, session_id);
+  if (session == NULL)
+    return FALSE;
+
+  gtk_list_box_unselect_all (GTK_LIST_BOX (self->session_list));
+  gtk_list_box_select_row (GTK_LIST_BOX (self->session_list), GTK_LIST_BOX_ROW (session->row));
+  gtk_widget_grab_focus (session->row);
+
+  return TRUE;
+}
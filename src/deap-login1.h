@@ -28,6 +28,20 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (DeapLogin1, deap_login1, DEAP, LOGIN1, GtkBox)
 
-GtkWidget *     deap_login1_get_instance    (void);
+/* Same signature as the DeapLogin1::session-* handlers */
+typedef void (*DeapLogin1SessionFunc) (DeapLogin1  *self,
+                                       const gchar *session_id,
+                                       guint        user_id,
+                                       const gchar *user_name,
+                                       const gchar *seat_id,
+                                       gpointer     user_data);
+
+GtkWidget *     deap_login1_get_instance      (void);
+
+void            deap_login1_foreach_session   (DeapLogin1            *self,
+                                               DeapLogin1SessionFunc  func,
+                                               gpointer               user_data);
+gboolean        deap_login1_select_session    (DeapLogin1            *self,
+                                               const gchar           *session_id);
 
 G_END_DECLS
@@ -0,0 +1,370 @@
+/* deap-metrics.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapMetrics"
+
+#include "deap-config.h"
+#include "deap-json.h"
+#include "deap-metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Histograms keep power-of-two buckets: bucket i holds samples in
+ * [2^i, 2^(i+1)) microseconds (bucket 0 also holds 0), so percentiles
+ * are approximated by a bucket's upper bound, clamped to min/max.
+ *
+ * This file must not log: the log writer thread records into it.
+ */
+#define N_BUCKETS   40
+
+typedef struct
+{
+  gchar           *name;
+  DeapMetricType   type;
+  gint64           value;
+  guint64          count;
+  gint64           sum;
+  gint64           min;
+  gint64           max;
+  guint64          buckets[N_BUCKETS];
+} Metric;
+
+static GMutex      metrics_mutex;
+static GHashTable *metrics = NULL;
+static gchar      *dump_path = NULL;
+
+/* Monotonic time at deap_metrics_init(), or else at the first metric */
+static gint64      start_time = 0;
+
+
+static void
+metric_free (gpointer data)
+{
+  Metric *metric = data;
+
+  g_free (metric->name);
+  g_free (metric);
+}
+
+/* Called with metrics_mutex held */
+static Metric *
+lookup_metric (const gchar    *name,
+               DeapMetricType  type)
+{
+  Metric *metric;
+
+  if (G_UNLIKELY (metrics == NULL)) {
+    metrics = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, metric_free);
+    if (start_time == 0)
+      start_time = g_get_monotonic_time ();
+  }
+
+  metric = g_hash_table_lookup (metrics, name);
+  if (metric == NULL) {
+    metric = g_new0 (Metric, 1);
+    metric->name = g_strdup (name);
+    metric->type = type;
+    g_hash_table_insert (metrics, metric->name, metric);
+  }
+
+  return metric;
+}
+
+void
+deap_metrics_counter_add (const gchar *name,
+                          gint64       delta)
+{
+  g_return_if_fail (name != NULL);
+
+  g_mutex_lock (&metrics_mutex);
+  lookup_metric (name, DEAP_METRIC_COUNTER)->value += delta;
+  g_mutex_unlock (&metrics_mutex);
+}
+
+void
+deap_metrics_gauge_set (const gchar *name,
+                        gint64       value)
+{
+  g_return_if_fail (name != NULL);
+
+  g_mutex_lock (&metrics_mutex);
+  lookup_metric (name, DEAP_METRIC_GAUGE)->value = value;
+  g_mutex_unlock (&metrics_mutex);
+}
+
+void
+deap_metrics_histogram_record (const gchar *name,
+                               gint64       usec)
+{
+  Metric *metric;
+  guint bucket;
+
+  g_return_if_fail (name != NULL);
+
+  usec = MAX (usec, 0);
+  bucket = usec > 1 ? MIN ((guint) g_bit_storage ((gulong) usec) - 1, N_BUCKETS - 1) : 0;
+
+  g_mutex_lock (&metrics_mutex);
+
+  metric = lookup_metric (name, DEAP_METRIC_HISTOGRAM);
+
+  if (metric->count == 0 || usec < metric->min)
+    metric->min = usec;
+  if (metric->count == 0 || usec > metric->max)
+    metric->max = usec;
+
+  metric->count++;
+  metric->sum += usec;
+  metric->buckets[bucket]++;
+
+  g_mutex_unlock (&metrics_mutex);
+}
+
+/* Called with metrics_mutex held */
+static gint64
+percentile (const Metric *metric,
+            gdouble       q)
+{
+  guint64 rank;
+  guint64 seen = 0;
+  guint i;
+
+  if (metric->count == 0)
+    return 0;
+
+  rank = (guint64) (q * metric->count + 0.5);
+  rank = CLAMP (rank, 1, metric->count);
+
+  for (i = 0; i < N_BUCKETS; i++) {
+    seen += metric->buckets[i];
+    if (seen >= rank)
+      return CLAMP ((G_GINT64_CONSTANT (1) << (i + 1)) - 1, metric->min, metric->max);
+  }
+
+  return metric->max;
+}
+
+/*
+ * deap_metrics_sample_process
+ *
+ * Refreshes the process gauges: the resident set size and its peak.
+ */
+void
+deap_metrics_sample_process (void)
+{
+  g_autofree gchar *statm = NULL;
+  g_autofree gchar *status = NULL;
+  const gchar *hwm;
+  gulong size;
+  gulong resident;
+  gulong peak_kb;
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL) &&
+      sscanf (statm, "%lu %lu", &size, &resident) == 2)
+    deap_metrics_gauge_set ("process.rss_bytes", (gint64) resident * sysconf (_SC_PAGESIZE));
+
+  if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL) &&
+      (hwm = strstr (status, "VmHWM:")) != NULL &&
+      sscanf (hwm, "VmHWM: %lu", &peak_kb) == 1)
+    deap_metrics_gauge_set ("process.peak_rss_bytes", (gint64) peak_kb * 1024);
+}
+
+static gint
+compare_snapshots (gconstpointer a,
+                   gconstpointer b)
+{
+  return strcmp (((const DeapMetricSnapshot *) a)->name,
+                 ((const DeapMetricSnapshot *) b)->name);
+}
+
+/*
+ * deap_metrics_foreach
+ *
+ * Calls @func for a snapshot of every metric, sorted by name. The names
+ * are only valid during the call.
+ */
+void
+deap_metrics_foreach (DeapMetricsFunc func,
+                      gpointer        user_data)
+{
+  g_autoptr(GArray) snapshots = NULL;
+  g_autoptr(GPtrArray) names = NULL;
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  g_return_if_fail (func != NULL);
+
+  snapshots = g_array_new (FALSE, TRUE, sizeof (DeapMetricSnapshot));
+  names = g_ptr_array_new_with_free_func (g_free);
+
+  g_mutex_lock (&metrics_mutex);
+
+  if (metrics != NULL) {
+    g_hash_table_iter_init (&iter, metrics);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+      const Metric *metric = value;
+      DeapMetricSnapshot snapshot = { NULL, };
+
+      snapshot.name = g_strdup (metric->name);
+      snapshot.type = metric->type;
+      snapshot.value = metric->value;
+      snapshot.count = metric->count;
+      snapshot.sum = metric->sum;
+      snapshot.min = metric->min;
+      snapshot.max = metric->max;
+      snapshot.p50 = percentile (metric, 0.50);
+      snapshot.p99 = percentile (metric, 0.99);
+
+      g_ptr_array_add (names, (gpointer) snapshot.name);
+      g_array_append_val (snapshots, snapshot);
+    }
+  }
+
+  g_mutex_unlock (&metrics_mutex);
+
+  g_array_sort (snapshots, compare_snapshots);
+
+  for (i = 0; i < snapshots->len; i++)
+    func (&g_array_index (snapshots, DeapMetricSnapshot, i), user_data);
+}
+
+static void
+append_json_cb (const DeapMetricSnapshot *snapshot,
+                gpointer                  user_data)
+{
+  GString *json = user_data;
+
+  if (json->str[json->len - 1] != '{')
+    g_string_append_c (json, ',');
+
+  g_string_append (json, "\n    ");
+  deap_json_append_string (json, snapshot->name);
+
+  switch (snapshot->type) {
+    case DEAP_METRIC_COUNTER:
+      g_string_append_printf (json, ": {\"type\": \"counter\", \"value\": %" G_GINT64_FORMAT "}",
+                              snapshot->value);
+      break;
+
+    case DEAP_METRIC_GAUGE:
+      g_string_append_printf (json, ": {\"type\": \"gauge\", \"value\": %" G_GINT64_FORMAT "}",
+                              snapshot->value);
+      break;
+
+    case DEAP_METRIC_HISTOGRAM:
+      g_string_append_printf (json,
+                              ": {\"type\": \"histogram\", \"unit\": \"us\", "
+                              "\"count\": %" G_GUINT64_FORMAT ", \"sum\": %" G_GINT64_FORMAT ", "
+                              "\"min\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT ", "
+                              "\"p50\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT "}",
+                              snapshot->count, snapshot->sum,
+                              snapshot->min, snapshot->max, snapshot->p50, snapshot->p99);
+      break;
+
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+/*
+ * deap_metrics_init
+ *
+ * Starts the clock of "uptime_us". To be called first thing in main(),
+ * before any other thread exists.
+ */
+void
+deap_metrics_init (void)
+{
+  if (start_time == 0)
+    start_time = g_get_monotonic_time ();
+}
+
+/*
+ * deap_metrics_to_json
+ *
+ * "uptime_us" is the time since deap_metrics_init(), not since boot as
+ * g_get_monotonic_time() alone would give.
+ *
+ * Returns: (transfer full): every metric, plus enough about the host to
+ * tell dumps of different machines apart
+ */
+gchar *
+deap_metrics_to_json (void)
+{
+  GString *json;
+  gint64 uptime;
+
+  deap_metrics_sample_process ();
+
+  g_mutex_lock (&metrics_mutex);
+  uptime = start_time != 0 ? g_get_monotonic_time () - start_time : 0;
+  g_mutex_unlock (&metrics_mutex);
+
+  json = g_string_new ("{\n  \"version\": ");
+  deap_json_append_string (json, PACKAGE_VERSION);
+  g_string_append (json, ",\n  \"host\": ");
+  deap_json_append_string (json, g_get_host_name ());
+  g_string_append_printf (json,
+                          ",\n  \"cpus\": %u,\n"
+                          "  \"uptime_us\": %" G_GINT64_FORMAT ",\n  \"metrics\": {",
+                          g_get_num_processors (), uptime);
+
+  deap_metrics_foreach (append_json_cb, json);
+
+  g_string_append (json, "\n  }\n}\n");
+
+  return g_string_free (json, FALSE);
+}
+
+/*
+ * deap_metrics_set_dump_path
+ *
+ * @path: (nullable): where deap_metrics_shutdown() writes the JSON, "-"
+ * for stdout
+ */
+void
+deap_metrics_set_dump_path (const gchar *path)
+{
+  g_free (dump_path);
+  dump_path = g_strdup (path);
+}
+
+void
+deap_metrics_shutdown (void)
+{
+  g_autofree gchar *json = NULL;
+  g_autoptr(GError) error = NULL;
+
+  if (dump_path == NULL)
+    return;
+
+  json = deap_metrics_to_json ();
+
+  if (g_strcmp0 (dump_path, "-") == 0)
+    fputs (json, stdout);
+  else if (!g_file_set_contents (dump_path, json, -1, &error))
+    g_printerr ("Could not write metrics to %s: %s\n", dump_path, error->message);
+
+  g_clear_pointer (&dump_path, g_free);
+}
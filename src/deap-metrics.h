@@ -0,0 +1,76 @@
+/* deap-metrics.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * In-process metrics
+ *
+ * Metrics are created on first use and identified by a dotted name, e.g.
+ * "dbus.call.org.freedesktop.login1.Manager.ListSessions". Recording is
+ * thread-safe and cheap enough for every D-Bus call and row, not for
+ * per-byte paths.
+ */
+typedef enum
+{
+  DEAP_METRIC_COUNTER,
+  DEAP_METRIC_GAUGE,
+  DEAP_METRIC_HISTOGRAM,
+} DeapMetricType;
+
+/* A copy of one metric, histograms are in microseconds */
+typedef struct
+{
+  const gchar     *name;
+  DeapMetricType   type;
+  gint64           value;     /* counter total or gauge value */
+  guint64          count;     /* histogram samples */
+  gint64           sum;
+  gint64           min;
+  gint64           max;
+  gint64           p50;
+  gint64           p99;
+} DeapMetricSnapshot;
+
+typedef void (*DeapMetricsFunc) (const DeapMetricSnapshot *snapshot,
+                                 gpointer                  user_data);
+
+void        deap_metrics_init               (void);
+
+void        deap_metrics_counter_add        (const gchar      *name,
+                                             gint64            delta);
+void        deap_metrics_gauge_set          (const gchar      *name,
+                                             gint64            value);
+void        deap_metrics_histogram_record   (const gchar      *name,
+                                             gint64            usec);
+
+void        deap_metrics_sample_process     (void);
+void        deap_metrics_foreach            (DeapMetricsFunc   func,
+                                             gpointer          user_data);
+gchar *     deap_metrics_to_json            (void);
+
+void        deap_metrics_set_dump_path      (const gchar      *path);
+void        deap_metrics_shutdown           (void);
+
+G_END_DECLS
@@ -0,0 +1,307 @@
+/* deap-palette-index.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapPaletteIndex"
+
+#include "deap-config.h"
+#include "deap-palette-index.h"
+
+#include <dazzle.h>
+
+/*
+ * The command palette's search index: a case-insensitive
+ * DzlFuzzyMutableIndex plus a hash table from key to item.
+ *
+ * dzl_fuzzy_mutable_index_remove() runs a whole fuzzy match to find
+ * the key and then only tombstones it, so the index never shrinks and
+ * removing k keys costs O(k·N). Removal here is O(1) instead: the item
+ * leaves the table and is marked dead, matches skip dead items, and
+ * once they pile up past a quarter of the live ones the index is built
+ * anew from the table, which keeps it at most 5/4 of the live size at
+ * amortized O(1) per removal.
+ *
+ * Widget- and logging-free, so benchmarks/palette.c can time it on its
+ * own.
+ */
+
+#define REBUILD_MIN_DEAD  64
+
+typedef struct
+{
+  gchar    *key;
+  gpointer  value;
+  gboolean  dead;
+} Item;
+
+struct _DeapPaletteIndex
+{
+  DzlFuzzyMutableIndex *index;
+
+  /* key -> Item, owning */
+  GHashTable           *items;
+
+  /* Items removed from the table but still in the index, owning */
+  GPtrArray            *dead;
+
+  GDestroyNotify        value_destroy;
+  guint                 in_bulk_insert : 1;
+};
+
+
+static void
+item_free (gpointer data)
+{
+  Item *item = data;
+
+  g_free (item->key);
+  g_free (item);
+}
+
+/*
+ * deap_palette_index_new
+ *
+ * @value_destroy: (nullable): called on values once they are removed
+ */
+DeapPaletteIndex *
+deap_palette_index_new (GDestroyNotify value_destroy)
+{
+  DeapPaletteIndex *self;
+
+  self = g_new0 (DeapPaletteIndex, 1);
+  self->index = dzl_fuzzy_mutable_index_new (FALSE);
+  self->items = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, item_free);
+  self->dead = g_ptr_array_new_with_free_func (item_free);
+  self->value_destroy = value_destroy;
+
+  return self;
+}
+
+static void
+destroy_value (DeapPaletteIndex *self,
+               Item             *item)
+{
+  if (self->value_destroy != NULL && item->value != NULL)
+    self->value_destroy (item->value);
+  item->value = NULL;
+}
+
+void
+deap_palette_index_free (DeapPaletteIndex *self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  if (self == NULL)
+    return;
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    destroy_value (self, value);
+
+  for (i = 0; i < self->dead->len; i++)
+    destroy_value (self, g_ptr_array_index (self->dead, i));
+
+  dzl_fuzzy_mutable_index_unref (self->index);
+  g_hash_table_unref (self->items);
+  g_ptr_array_unref (self->dead);
+  g_free (self);
+}
+
+static void
+rebuild (DeapPaletteIndex *self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  dzl_fuzzy_mutable_index_unref (self->index);
+  self->index = dzl_fuzzy_mutable_index_new (FALSE);
+
+  dzl_fuzzy_mutable_index_begin_bulk_insert (self->index);
+
+  g_hash_table_iter_init (&iter, self->items);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    Item *item = value;
+
+    dzl_fuzzy_mutable_index_insert (self->index, item->key, item);
+  }
+
+  dzl_fuzzy_mutable_index_end_bulk_insert (self->index);
+
+  for (i = 0; i < self->dead->len; i++)
+    destroy_value (self, g_ptr_array_index (self->dead, i));
+  g_ptr_array_set_size (self->dead, 0);
+}
+
+static void
+maybe_rebuild (DeapPaletteIndex *self)
+{
+  if (self->in_bulk_insert)
+    return;
+
+  if (self->dead->len > MAX (REBUILD_MIN_DEAD, g_hash_table_size (self->items) / 4))
+    rebuild (self);
+}
+
+void
+deap_palette_index_begin_bulk_insert (DeapPaletteIndex *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (!self->in_bulk_insert);
+
+  self->in_bulk_insert = TRUE;
+  dzl_fuzzy_mutable_index_begin_bulk_insert (self->index);
+}
+
+void
+deap_palette_index_end_bulk_insert (DeapPaletteIndex *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->in_bulk_insert);
+
+  dzl_fuzzy_mutable_index_end_bulk_insert (self->index);
+  self->in_bulk_insert = FALSE;
+
+  maybe_rebuild (self);
+}
+
+/*
+ * deap_palette_index_insert
+ *
+ * Returns: FALSE if @key is taken, in which case @value is left alone
+ */
+gboolean
+deap_palette_index_insert (DeapPaletteIndex *self,
+                           const gchar      *key,
+                           gpointer          value)
+{
+  Item *item;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+
+  if (g_hash_table_contains (self->items, key))
+    return FALSE;
+
+  item = g_new0 (Item, 1);
+  item->key = g_strdup (key);
+  item->value = value;
+
+  g_hash_table_insert (self->items, item->key, item);
+  dzl_fuzzy_mutable_index_insert (self->index, item->key, item);
+
+  return TRUE;
+}
+
+/*
+ * deap_palette_index_remove
+ *
+ * Destroys the value of @key, possibly only at the next rebuild.
+ *
+ * Returns: FALSE if there is no such key
+ */
+gboolean
+deap_palette_index_remove (DeapPaletteIndex *self,
+                           const gchar      *key)
+{
+  Item *item;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+  g_return_val_if_fail (key != NULL, FALSE);
+
+  item = g_hash_table_lookup (self->items, key);
+  if (item == NULL)
+    return FALSE;
+
+  g_hash_table_steal (self->items, key);
+  item->dead = TRUE;
+  g_ptr_array_add (self->dead, item);
+
+  maybe_rebuild (self);
+
+  return TRUE;
+}
+
+gpointer
+deap_palette_index_lookup (DeapPaletteIndex *self,
+                           const gchar      *key)
+{
+  Item *item;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  item = g_hash_table_lookup (self->items, key);
+
+  return item != NULL ? item->value : NULL;
+}
+
+guint
+deap_palette_index_get_n_live (DeapPaletteIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return g_hash_table_size (self->items);
+}
+
+guint
+deap_palette_index_get_n_dead (DeapPaletteIndex *self)
+{
+  g_return_val_if_fail (self != NULL, 0);
+
+  return self->dead->len;
+}
+
+/*
+ * deap_palette_index_match
+ *
+ * Asks the fuzzy index for enough matches that @max_results survive
+ * skipping the dead ones, which are bounded by the rebuild threshold.
+ *
+ * Returns: (transfer container): the values of the best matches, best
+ * first
+ */
+GPtrArray *
+deap_palette_index_match (DeapPaletteIndex *self,
+                          const gchar      *query,
+                          guint             max_results)
+{
+  g_autoptr(GArray) matches = NULL;
+  GPtrArray *ret;
+  guint i;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (query != NULL, NULL);
+
+  ret = g_ptr_array_sized_new (max_results);
+
+  matches = dzl_fuzzy_mutable_index_match (self->index, query, max_results + self->dead->len);
+
+  for (i = 0; i < matches->len && ret->len < max_results; i++) {
+    const DzlFuzzyMutableIndexMatch *match = &g_array_index (matches, DzlFuzzyMutableIndexMatch, i);
+    Item *item = match->value;
+
+    if (!item->dead)
+      g_ptr_array_add (ret, item->value);
+  }
+
+  return ret;
+}
@@ -0,0 +1,51 @@
+/* deap-palette-index.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _DeapPaletteIndex DeapPaletteIndex;
+
+DeapPaletteIndex *  deap_palette_index_new                (GDestroyNotify    value_destroy);
+void                deap_palette_index_free               (DeapPaletteIndex *self);
+
+void                deap_palette_index_begin_bulk_insert  (DeapPaletteIndex *self);
+void                deap_palette_index_end_bulk_insert    (DeapPaletteIndex *self);
+
+gboolean            deap_palette_index_insert             (DeapPaletteIndex *self,
+                                                           const gchar      *key,
+                                                           gpointer          value);
+gboolean            deap_palette_index_remove             (DeapPaletteIndex *self,
+                                                           const gchar      *key);
+gpointer            deap_palette_index_lookup             (DeapPaletteIndex *self,
+                                                           const gchar      *key);
+guint               deap_palette_index_get_n_live         (DeapPaletteIndex *self);
+guint               deap_palette_index_get_n_dead         (DeapPaletteIndex *self);
+
+GPtrArray *         deap_palette_index_match              (DeapPaletteIndex *self,
+                                                           const gchar      *query,
+                                                           guint             max_results);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (DeapPaletteIndex, deap_palette_index_free)
+
+G_END_DECLS
@@ -0,0 +1,177 @@
+/* deap-profile.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapProfile"
+
+#include "deap-config.h"
+#include "deap-debug.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Startup profiling marks
+ *
+ * When DEAP_PROFILE_STARTUP is set, every startup phase is written as
+ * "DEAP-MARK <phase> <monotonic usec>" to the file it names, or to
+ * stderr for "-". Once all pages are populated the application quits,
+ * so benchmarks/startup.py can launch deap repeatedly.
+ *
+ * While profiling, a heartbeat at STALL_TICK_MSEC records how late it
+ * fires into the "mainloop.stall" histogram: the time the main loop spent
+ * in a single dispatch it could not interrupt.
+ */
+
+#define STALL_TICK_MSEC   10
+
+static gint profile_fd = -1;
+static guint pages_expected = 0;
+static GHashTable *pages_populated = NULL;
+static gint64 last_tick = 0;
+
+static gboolean
+stall_tick_cb (gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  deap_metrics_histogram_record ("mainloop.stall",
+                                 MAX (now - last_tick - STALL_TICK_MSEC * 1000, 0));
+  last_tick = now;
+
+  return G_SOURCE_CONTINUE;
+}
+
+void
+deap_profile_init (void)
+{
+  const gchar *path;
+
+  path = g_getenv ("DEAP_PROFILE_STARTUP");
+  if (path == NULL || *path == '\0')
+    return;
+
+  if (g_strcmp0 (path, "-") == 0)
+    profile_fd = STDERR_FILENO;
+  else
+    profile_fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (profile_fd < 0) {
+    deap_warn_msg ("Could not open %s for profiling marks", path);
+    return;
+  }
+
+  pages_populated = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  last_tick = g_get_monotonic_time ();
+  g_timeout_add (STALL_TICK_MSEC, stall_tick_cb, NULL);
+}
+
+gboolean
+deap_profile_is_enabled (void)
+{
+  return profile_fd >= 0;
+}
+
+void
+deap_profile_mark (const gchar *phase)
+{
+  gchar buffer[256];
+  gint len;
+
+  if (profile_fd < 0)
+    return;
+
+  len = g_snprintf (buffer, sizeof (buffer),
+                    "DEAP-MARK %s %" G_GINT64_FORMAT "\n",
+                    phase,
+                    g_get_monotonic_time ());
+  if (write (profile_fd, buffer, MIN (len, (gint)sizeof (buffer) - 1)) < 0)
+    deap_warn_msg ("Could not write profiling mark %s", phase);
+}
+
+static void
+after_paint_cb (GdkFrameClock *frame_clock,
+                gpointer       user_data)
+{
+  deap_profile_mark ("first-frame");
+
+  g_signal_handlers_disconnect_by_func (frame_clock, after_paint_cb, user_data);
+}
+
+static void
+watched_widget_realize_cb (GtkWidget *widget,
+                           gpointer   user_data)
+{
+  GdkFrameClock *frame_clock;
+
+  g_signal_handlers_disconnect_by_func (widget, watched_widget_realize_cb, user_data);
+
+  frame_clock = gtk_widget_get_frame_clock (widget);
+  if (frame_clock != NULL)
+    g_signal_connect (frame_clock, "after-paint", G_CALLBACK (after_paint_cb), NULL);
+}
+
+void
+deap_profile_watch_first_frame (GtkWidget *widget)
+{
+  g_return_if_fail (GTK_IS_WIDGET (widget));
+
+  if (profile_fd < 0)
+    return;
+
+  if (gtk_widget_get_realized (widget))
+    watched_widget_realize_cb (widget, NULL);
+  else
+    g_signal_connect (widget, "realize", G_CALLBACK (watched_widget_realize_cb), NULL);
+}
+
+void
+deap_profile_expect_pages (guint n_pages)
+{
+  pages_expected = n_pages;
+}
+
+void
+deap_profile_page_populated (const gchar *page_name)
+{
+  g_autofree gchar *phase = NULL;
+  GApplication *app;
+
+  if (profile_fd < 0)
+    return;
+
+  /* Only the first population of a page is a startup phase */
+  if (!g_hash_table_add (pages_populated, g_strdup (page_name)))
+    return;
+
+  phase = g_strdup_printf ("page:%s", page_name);
+  deap_profile_mark (phase);
+
+  if (pages_expected == 0 || g_hash_table_size (pages_populated) < pages_expected)
+    return;
+
+  deap_profile_mark ("all-pages");
+
+  app = g_application_get_default ();
+  if (app != NULL)
+    g_application_quit (app);
+}
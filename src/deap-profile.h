@@ -0,0 +1,34 @@
+/* deap-profile.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+void        deap_profile_init                 (void);
+gboolean    deap_profile_is_enabled           (void);
+void        deap_profile_mark                 (const gchar *phase);
+void        deap_profile_watch_first_frame    (GtkWidget   *widget);
+void        deap_profile_expect_pages         (guint        n_pages);
+void        deap_profile_page_populated       (const gchar *page_name);
+
+G_END_DECLS
@@ -0,0 +1,192 @@
+/* deap-shell-actions.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapShellActions"
+
+#include "deap-config.h"
+#include "deap-bus-manager.h"
+#include "deap-dbus-shell.h"
+#include "deap-debug.h"
+#include "deap-metrics.h"
+#include "deap-shell-actions.h"
+
+#include <glib/gi18n.h>
+
+/*
+ * Application actions for the fire-and-forget methods of org.gnome.Shell.
+ *
+ * Nothing reads their replies, so they go out as single method call
+ * messages flagged NO_REPLY_EXPECTED (the Shell does not even send one)
+ * and NO_AUTO_START (a missing Shell is not worth activating). Repeated
+ * activations are coalesced:
+ *
+ *  - while one is waiting for the proxy, further ones merge into it;
+ *  - once sent, the same action is dropped for COALESCE_USEC, which
+ *    swallows double clicks and accelerator key repeat.
+ */
+
+#define COALESCE_USEC     (150 * 1000)
+
+typedef struct
+{
+  const gchar  *action_name;
+  const gchar  *detailed_name;
+  const gchar  *label;
+  const gchar  *method_name;
+  const gchar  *accels[2];
+
+  gboolean      pending;
+  gint64        last_sent;
+  guint         n_coalesced;
+} ShellAction;
+
+static ShellAction shell_actions[] = {
+  { "show-applications", "app.show-applications", N_("Show Applications"),
+    "ShowApplications", { "<Primary><Alt>a", NULL }, },
+  { "focus-search", "app.focus-search", N_("Focus Search"),
+    "FocusSearch", { "<Primary><Alt>s", NULL }, },
+};
+
+
+static void
+send_shell_action (GDBusProxy  *proxy,
+                   ShellAction *action)
+{
+  g_autoptr(GDBusMessage) message = NULL;
+  g_autoptr(GError) error = NULL;
+
+  message = g_dbus_message_new_method_call (g_dbus_proxy_get_name (proxy),
+                                            g_dbus_proxy_get_object_path (proxy),
+                                            g_dbus_proxy_get_interface_name (proxy),
+                                            action->method_name);
+  g_dbus_message_set_flags (message,
+                            G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED |
+                            G_DBUS_MESSAGE_FLAGS_NO_AUTO_START);
+
+  if (!g_dbus_connection_send_message (g_dbus_proxy_get_connection (proxy),
+                                       message,
+                                       G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                       NULL,
+                                       &error)) {
+    deap_warn_msg ("Error sending org.gnome.Shell.%s: %s", action->method_name, error->message);
+    return;
+  }
+
+  action->last_sent = g_get_monotonic_time ();
+
+  deap_metrics_counter_add ("shell.actions.sent", 1);
+  deap_metrics_counter_add ("shell.actions.coalesced", action->n_coalesced);
+
+  deap_trace_msg ("org.gnome.Shell.%s sent, %u activations coalesced",
+                  action->method_name, action->n_coalesced);
+  action->n_coalesced = 0;
+}
+
+static void
+shell_proxy_ready_cb (GObject      *source,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  ShellAction *action = user_data;
+  g_autoptr(GDBusProxy) proxy = NULL;
+  g_autoptr(GError) error = NULL;
+
+  action->pending = FALSE;
+
+  proxy = deap_bus_manager_get_proxy_finish (DEAP_BUS_MANAGER (source), res, &error);
+  if (error) {
+    deap_warn_msg ("Error acquiring org.gnome.Shell: %s", error->message);
+    return;
+  }
+
+  send_shell_action (proxy, action);
+}
+
+static void
+activate_shell_action_cb (GSimpleAction *simple,
+                          GVariant      *parameter,
+                          gpointer       user_data)
+{
+  ShellAction *action = user_data;
+
+  if (action->pending ||
+      g_get_monotonic_time () - action->last_sent < COALESCE_USEC) {
+    action->n_coalesced++;
+    return;
+  }
+
+  action->pending = TRUE;
+
+  /* Same type and flags as DeapGnomeShell, so this is a cache hit */
+  deap_bus_manager_get_proxy_async (deap_bus_manager_get_default (),
+                                    G_BUS_TYPE_SESSION,
+                                    DEAP_DBUS_TYPE_SHELL_PROXY,
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                    G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                    "org.gnome.Shell",
+                                    "/org/gnome/Shell",
+                                    "org.gnome.Shell",
+                                    NULL,
+                                    shell_proxy_ready_cb,
+                                    action);
+}
+
+/*
+ * deap_shell_actions_install
+ *
+ * Adds app.show-applications and app.focus-search, with accelerators,
+ * to @application.
+ */
+void
+deap_shell_actions_install (GtkApplication *application)
+{
+  guint i;
+
+  g_return_if_fail (GTK_IS_APPLICATION (application));
+
+  for (i = 0; i < G_N_ELEMENTS (shell_actions); i++) {
+    ShellAction *action = &shell_actions[i];
+    g_autoptr(GSimpleAction) simple = NULL;
+
+    simple = g_simple_action_new (action->action_name, NULL);
+    g_signal_connect (simple, "activate", G_CALLBACK (activate_shell_action_cb), action);
+    g_action_map_add_action (G_ACTION_MAP (application), G_ACTION (simple));
+
+    gtk_application_set_accels_for_action (application, action->detailed_name, action->accels);
+  }
+}
+
+/*
+ * deap_shell_actions_foreach
+ *
+ * Calls @func with the detailed name and the translated label of every
+ * action deap_shell_actions_install() adds.
+ */
+void
+deap_shell_actions_foreach (DeapShellActionsFunc func,
+                            gpointer             user_data)
+{
+  guint i;
+
+  g_return_if_fail (func != NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (shell_actions); i++)
+    func (shell_actions[i].detailed_name, _(shell_actions[i].label), user_data);
+}
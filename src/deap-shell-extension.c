@@ -0,0 +1,379 @@
+/* deap-shell-extension.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapShellExtension"
+
+#include "deap-debug.h"
+#include "deap-shell-extension.h"
+
+/*
+ * One entry of org.gnome.Shell.Extensions.ListExtensions, i.e. the
+ * a{sv} describing a single extension.
+ *
+ * The strings are borrowed from @info, which is a child of the D-Bus
+ * reply and so shares its serialized buffer: a whole refresh costs the
+ * reply buffer plus one object per extension, no string copies. Reading
+ * the fields still allocates GVariant wrappers for each {sv} entry, which
+ * are dropped right away; tests/test-shell-extension.c keeps count.
+ *
+ * The UUID is the identity (and the key of the page's index) so it must
+ * survive swapping @info on update; it is interned instead, which only
+ * allocates the first time a UUID is ever seen.
+ */
+struct _DeapShellExtension
+{
+  GObject   parent_instance;
+
+  GVariant    *info;
+
+  const gchar *uuid;
+  const gchar *name;
+  const gchar *description;
+  const gchar *url;
+
+  DeapShellExtensionState state;
+};
+
+enum {
+  PROP_0,
+  PROP_UUID,
+  PROP_NAME,
+  PROP_DESCRIPTION,
+  PROP_URL,
+  PROP_STATE,
+  N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+G_DEFINE_TYPE (DeapShellExtension, deap_shell_extension, G_TYPE_OBJECT)
+
+
+/* --- GObject --- */
+static void
+deap_shell_extension_finalize (GObject *object)
+{
+  DeapShellExtension *self = DEAP_SHELL_EXTENSION (object);
+
+  g_clear_pointer (&self->info, g_variant_unref);
+
+  G_OBJECT_CLASS (deap_shell_extension_parent_class)->finalize (object);
+}
+
+static void
+deap_shell_extension_get_property (GObject    *object,
+                                   guint       prop_id,
+                                   GValue     *value,
+                                   GParamSpec *pspec)
+{
+  DeapShellExtension *self = DEAP_SHELL_EXTENSION (object);
+
+  switch (prop_id) {
+    case PROP_UUID:
+      g_value_set_string (value, self->uuid);
+      break;
+
+    case PROP_NAME:
+      g_value_set_string (value, self->name);
+      break;
+
+    case PROP_DESCRIPTION:
+      g_value_set_string (value, self->description);
+      break;
+
+    case PROP_URL:
+      g_value_set_string (value, self->url);
+      break;
+
+    case PROP_STATE:
+      g_value_set_int (value, self->state);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+deap_shell_extension_class_init (DeapShellExtensionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = deap_shell_extension_finalize;
+  object_class->get_property = deap_shell_extension_get_property;
+
+  properties [PROP_UUID] =
+    g_param_spec_string ("uuid", "UUID", "UUID of the extension",
+                         NULL, (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_NAME] =
+    g_param_spec_string ("name", "Name", "Name of the extension",
+                         NULL, (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_DESCRIPTION] =
+    g_param_spec_string ("description", "Description", "Description of the extension",
+                         NULL, (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_URL] =
+    g_param_spec_string ("url", "URL", "Homepage of the extension",
+                         NULL, (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  properties [PROP_STATE] =
+    g_param_spec_int ("state", "State", "DeapShellExtensionState of the extension",
+                      0, G_MAXINT, DEAP_SHELL_EXTENSION_STATE_UNKNOWN,
+                      (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
+}
+
+static void
+deap_shell_extension_init (DeapShellExtension *self)
+{
+}
+
+typedef struct
+{
+  const gchar *uuid;
+  const gchar *name;
+  const gchar *description;
+  const gchar *url;
+  gdouble      state;
+} ExtensionFields;
+
+/*
+ * One pass over the a{sv}, borrowing every string from @info instead of
+ * looking each key up (and copying it) separately. Every entry still
+ * costs four transient GVariant wrappers (the entry, its key, its v and
+ * the value inside), which GVariant gives no way around, but none of
+ * them outlives the loop. The entry is taken apart by hand because
+ * g_variant_iter_next() with "{&sv}" also allocates a GVariantType to
+ * check the format string against, once per entry.
+ */
+static void
+read_fields (GVariant        *info,
+             ExtensionFields *fields)
+{
+  GVariantIter iter;
+  GVariant *entry;
+
+  /* gnome-shell sends the state as a double */
+  fields->state = -1;
+
+  g_variant_iter_init (&iter, info);
+  while ((entry = g_variant_iter_next_value (&iter))) {
+    g_autoptr(GVariant) key_value = g_variant_get_child_value (entry, 0);
+    g_autoptr(GVariant) boxed = g_variant_get_child_value (entry, 1);
+    g_autoptr(GVariant) value = g_variant_get_variant (boxed);
+    const gchar *key = g_variant_get_string (key_value, NULL);
+
+    if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+      if (g_str_equal (key, "uuid"))
+        fields->uuid = g_variant_get_string (value, NULL);
+      else if (g_str_equal (key, "name"))
+        fields->name = g_variant_get_string (value, NULL);
+      else if (g_str_equal (key, "description"))
+        fields->description = g_variant_get_string (value, NULL);
+      else if (g_str_equal (key, "url"))
+        fields->url = g_variant_get_string (value, NULL);
+    } else if (g_variant_is_of_type (value, G_VARIANT_TYPE_DOUBLE) &&
+               g_str_equal (key, "state")) {
+      fields->state = g_variant_get_double (value);
+    }
+
+    g_variant_unref (entry);
+  }
+}
+
+DeapShellExtension *
+deap_shell_extension_new (GVariant *info   /* a{sv} type */)
+{
+  DeapShellExtension *self;
+  ExtensionFields fields = { NULL, };
+
+  g_return_val_if_fail (info != NULL, NULL);
+
+  self = g_object_new (DEAP_TYPE_SHELL_EXTENSION, NULL);
+
+  read_fields (info, &fields);
+
+  self->info = g_variant_ref (info);
+  self->uuid = g_intern_string (fields.uuid);
+  self->name = fields.name;
+  self->description = fields.description;
+  self->url = fields.url;
+
+  if (fields.state >= 0)
+    self->state = (gint) fields.state;
+
+  return self;
+}
+
+/*
+ * deap_shell_extension_update
+ *
+ * Applies a newer a{sv} of the same extension, e.g. the one carried by
+ * ExtensionStateChanged, notifying only the properties which changed.
+ */
+void
+deap_shell_extension_update (DeapShellExtension *self,
+                             GVariant           *info   /* a{sv} type */)
+{
+  ExtensionFields fields = { NULL, };
+  gboolean name_changed;
+  gboolean description_changed;
+  gboolean url_changed;
+  gboolean state_changed;
+
+  g_return_if_fail (DEAP_IS_SHELL_EXTENSION (self));
+  g_return_if_fail (info != NULL);
+
+  read_fields (info, &fields);
+
+  /* Compare while the old strings are still backed by the old info */
+  name_changed = g_strcmp0 (self->name, fields.name) != 0;
+  description_changed = g_strcmp0 (self->description, fields.description) != 0;
+  url_changed = g_strcmp0 (self->url, fields.url) != 0;
+  state_changed = fields.state >= 0 && (gint) fields.state != (gint) self->state;
+
+  g_variant_ref (info);
+  g_clear_pointer (&self->info, g_variant_unref);
+  self->info = info;
+
+  self->name = fields.name;
+  self->description = fields.description;
+  self->url = fields.url;
+
+  if (fields.state >= 0)
+    self->state = (gint) fields.state;
+
+  g_object_freeze_notify (G_OBJECT (self));
+
+  if (name_changed)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_NAME]);
+  if (description_changed)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_DESCRIPTION]);
+  if (url_changed)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_URL]);
+  if (state_changed)
+    g_object_notify_by_pspec (G_OBJECT (self), properties [PROP_STATE]);
+
+  g_object_thaw_notify (G_OBJECT (self));
+}
+
+const gchar *
+deap_shell_extension_get_uuid (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), NULL);
+
+  return self->uuid;
+}
+
+/*
+ * deap_shell_extension_get_info
+ *
+ * Returns: (transfer none): the a{sv} the strings are borrowed from
+ */
+GVariant *
+deap_shell_extension_get_info (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), NULL);
+
+  return self->info;
+}
+
+const gchar *
+deap_shell_extension_get_name (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), NULL);
+
+  return self->name;
+}
+
+const gchar *
+deap_shell_extension_get_description (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), NULL);
+
+  return self->description;
+}
+
+const gchar *
+deap_shell_extension_get_url (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), NULL);
+
+  return self->url;
+}
+
+DeapShellExtensionState
+deap_shell_extension_get_state (DeapShellExtension *self)
+{
+  g_return_val_if_fail (DEAP_IS_SHELL_EXTENSION (self), DEAP_SHELL_EXTENSION_STATE_UNKNOWN);
+
+  return self->state;
+}
+
+const gchar *
+deap_shell_extension_state_to_string (DeapShellExtensionState state)
+{
+  switch (state) {
+    case DEAP_SHELL_EXTENSION_STATE_ENABLED:      return "Enabled";
+    case DEAP_SHELL_EXTENSION_STATE_DISABLED:     return "Disabled";
+    case DEAP_SHELL_EXTENSION_STATE_ERROR:        return "Error";
+    case DEAP_SHELL_EXTENSION_STATE_OUT_OF_DATE:  return "Out of date";
+    case DEAP_SHELL_EXTENSION_STATE_DOWNLOADING:  return "Downloading";
+    case DEAP_SHELL_EXTENSION_STATE_INITIALIZED:  return "Initialized";
+    case DEAP_SHELL_EXTENSION_STATE_UNINSTALLED:  return "Uninstalled";
+
+    default:
+      return "Unknown";
+  }
+}
+
+/*
+ * deap_shell_extension_parse_list
+ *
+ * Parses the a{sa{sv}} returned by ListExtensions.
+ * Returns: (transfer full): a GPtrArray of DeapShellExtension
+ */
+GPtrArray *
+deap_shell_extension_parse_list (GVariant *dict)
+{
+  GVariantIter iter;
+  GPtrArray *ret = NULL;
+  GVariant *child = NULL;
+
+  g_return_val_if_fail (dict != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (dict, G_VARIANT_TYPE ("a{sa{sv}}")), NULL);
+
+  ret = g_ptr_array_new_full (g_variant_n_children (dict), g_object_unref);
+
+  g_variant_iter_init (&iter, dict);
+  while ((child = g_variant_iter_next_value (&iter))) {
+    g_autoptr(GVariant) info = NULL;
+
+    info = g_variant_get_child_value (child, 1);
+    g_ptr_array_add (ret, deap_shell_extension_new (info));
+
+    g_variant_unref (child);
+  }
+
+  return ret;
+}
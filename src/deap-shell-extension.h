@@ -0,0 +1,60 @@
+/* deap-shell-extension.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define DEAP_TYPE_SHELL_EXTENSION (deap_shell_extension_get_type ())
+
+G_DECLARE_FINAL_TYPE (DeapShellExtension, deap_shell_extension, DEAP, SHELL_EXTENSION, GObject)
+
+/* ExtensionState of gnome-shell's js/misc/extensionUtils.js */
+typedef enum
+{
+  DEAP_SHELL_EXTENSION_STATE_UNKNOWN      = 0,
+  DEAP_SHELL_EXTENSION_STATE_ENABLED      = 1,
+  DEAP_SHELL_EXTENSION_STATE_DISABLED     = 2,
+  DEAP_SHELL_EXTENSION_STATE_ERROR        = 3,
+  DEAP_SHELL_EXTENSION_STATE_OUT_OF_DATE  = 4,
+  DEAP_SHELL_EXTENSION_STATE_DOWNLOADING  = 5,
+  DEAP_SHELL_EXTENSION_STATE_INITIALIZED  = 6,
+  DEAP_SHELL_EXTENSION_STATE_UNINSTALLED  = 99,
+} DeapShellExtensionState;
+
+DeapShellExtension *  deap_shell_extension_new              (GVariant           *info);
+
+void                  deap_shell_extension_update           (DeapShellExtension *self,
+                                                             GVariant           *info);
+
+const gchar *         deap_shell_extension_get_uuid         (DeapShellExtension *self);
+GVariant *            deap_shell_extension_get_info         (DeapShellExtension *self);
+const gchar *         deap_shell_extension_get_name         (DeapShellExtension *self);
+const gchar *         deap_shell_extension_get_description  (DeapShellExtension *self);
+const gchar *         deap_shell_extension_get_url          (DeapShellExtension *self);
+DeapShellExtensionState
+                      deap_shell_extension_get_state        (DeapShellExtension *self);
+const gchar *         deap_shell_extension_state_to_string  (DeapShellExtensionState state);
+
+GPtrArray *           deap_shell_extension_parse_list       (GVariant           *dict);
+
+G_END_DECLS
@@ -21,29 +21,290 @@
 #define G_LOG_DOMAIN "DeapVirtualTerminal"
 
 #include "deap-debug.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
 #include "deap-virtual-terminal.h"
 
+#include <glib/gi18n.h>
+#include <sys/wait.h>
 #include <vte/vte.h>
 
+/* VteRegex takes PCRE2 flags; the code unit width is VTE's business */
+#define PCRE2_CODE_UNIT_WIDTH 0
+#include <pcre2.h>
+
 struct _DeapVirtualTerminal
 {
-  GtkBox      parent_instance;
+  GtkBox        parent_instance;
+
+  GtkWidget     *main_box;
+  GtkWidget     *terminal;
+  GtkWidget     *status_revealer;
+  GtkWidget     *status_label;
+  GtkWidget     *search_bar;
+  GtkWidget     *search_entry;
+
+  GCancellable  *cancellable;
+
+  /* Respawn rate limiting, see internal_respawn_terminal_cb() */
+  gdouble        respawn_tokens;
+  gint64         respawn_refilled_at;
+  guint          respawn_backoff_msec;
+  guint          respawn_source_id;
+  guint          n_suppressed;
 
-  GtkWidget   *main_box;
-  GtkWidget   *terminal;
+  /* Compiled search regexes, most recently used first */
+  GQueue         regex_lru;
+  GHashTable    *regex_cache;
 };
 
+/*
+ * A spare shell which is spawned ahead of time, so attaching a shell to
+ * the terminal never has to wait for the PTY and fork/exec. It is
+ * watched until attached: one which exits while idle is reaped, and
+ * only replaced the next time the terminal page is mapped.
+ */
+typedef struct
+{
+  VtePty    *pty;
+  GPid       pid;
+  gboolean   spawning;
+  guint      child_watch_id;
+} WarmShell;
+
 G_DEFINE_TYPE (DeapVirtualTerminal, deap_virtual_terminal, GTK_TYPE_BOX)
 
+/*
+ * Respawns are paid for from a bucket of RESPAWN_BURST tokens, refilled
+ * at one per RESPAWN_REFILL_USEC. With the bucket empty the shell is
+ * crash-looping: respawns are delayed by a backoff starting at
+ * RESPAWN_BACKOFF_MIN_MSEC and doubling up to RESPAWN_BACKOFF_MAX_MSEC,
+ * which, like the count of respawns put off, is only reset once the
+ * bucket is full again.
+ */
+#define RESPAWN_BURST             5
+#define RESPAWN_REFILL_USEC       (10 * G_USEC_PER_SEC)
+#define RESPAWN_BACKOFF_MIN_MSEC  1000
+#define RESPAWN_BACKOFF_MAX_MSEC  (60 * 1000)
+
+/* Build and journal logs get dumped in here, so keep plenty */
+#define SCROLLBACK_LINES          100000
+
+#define REGEX_CACHE_SIZE          32
+#define SEARCH_COMPILE_FLAGS      (PCRE2_UTF | PCRE2_UCP | PCRE2_MULTILINE)
+
+typedef struct
+{
+  gchar     *key;
+  VteRegex  *regex;
+} CachedRegex;
+
+G_LOCK_DEFINE_STATIC (user_shell_lock);
+
+static gchar *user_shell = NULL;
+static WarmShell warm_shell = { NULL, -1, FALSE, 0 };
+
+
+/* --- User Shell --- */
+static gchar *
+dup_cached_user_shell (void)
+{
+  gchar *ret;
+
+  G_LOCK (user_shell_lock);
+  ret = g_strdup (user_shell);
+  G_UNLOCK (user_shell_lock);
+
+  return ret;
+}
 
 static void
-internal_spawn_terminal (DeapVirtualTerminal *self)
+resolve_user_shell_thread (GTask        *task,
+                           gpointer      source_object,
+                           gpointer      task_data,
+                           GCancellable *cancellable)
 {
-  gchar* command[2] = { NULL };
+  gchar *shell;
 
-  DEAP_TRACE_ENTRY;
+  /* getpwuid() may go through NSS, e.g. LDAP or SSSD, and block */
+  shell = vte_get_user_shell ();
+  if (shell == NULL)
+    shell = g_strdup ("/bin/sh");
+
+  G_LOCK (user_shell_lock);
+  if (user_shell == NULL)
+    user_shell = g_strdup (shell);
+  G_UNLOCK (user_shell_lock);
+
+  g_task_return_pointer (task, shell, g_free);
+}
+
+static void
+resolve_user_shell_async (GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  g_autoptr(GTask) task = NULL;
+  gchar *shell;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, resolve_user_shell_async);
+
+  shell = dup_cached_user_shell ();
+  if (shell != NULL) {
+    g_task_return_pointer (task, shell, g_free);
+    return;
+  }
+
+  g_task_run_in_thread (task, resolve_user_shell_thread);
+}
+
+static gchar *
+resolve_user_shell_finish (GAsyncResult  *res,
+                           GError       **error)
+{
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+/* --- End of User Shell --- */
+
+
+/* --- Warm Shell --- */
+static void
+warm_shell_exited_cb (GPid     pid,
+                      gint     status,
+                      gpointer user_data)
+{
+  /* Child watches are one-shot */
+  warm_shell.child_watch_id = 0;
+
+  deap_warn_msg ("Warm shell %d exited while idle, status %d", pid, status);
+  deap_metrics_counter_add ("terminal.warm_shell.deaths", 1);
+
+  g_spawn_close_pid (pid);
+  g_clear_object (&warm_shell.pty);
+  warm_shell.pid = -1;
+}
+
+static void
+warm_shell_spawned_cb (GObject      *source,
+                       GAsyncResult *res,
+                       gpointer      user_data)
+{
+  VtePty *pty = VTE_PTY (source);
+  g_autoptr(GError) error = NULL;
+  GPid pid = -1;
+
+  warm_shell.spawning = FALSE;
+
+  /* Takes over the reference from vte_pty_new_sync() */
+  if (!vte_pty_spawn_finish (pty, res, &pid, &error)) {
+    deap_warn_msg ("Error pre-spawning shell: %s", error->message);
+    g_object_unref (pty);
+    return;
+  }
+
+  warm_shell.pty = pty;
+  warm_shell.pid = pid;
+  warm_shell.child_watch_id = g_child_watch_add (pid, warm_shell_exited_cb, NULL);
+
+  deap_trace_msg ("Warm shell ready, pid %d", pid);
+}
+
+static void
+warm_shell_resolved_cb (GObject      *source,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *shell = NULL;
+  VtePty *pty;
+  gchar *command[2] = { NULL };
+
+  shell = resolve_user_shell_finish (res, &error);
+  if (shell == NULL) {
+    deap_warn_msg ("Error resolving user shell: %s", error->message);
+    warm_shell.spawning = FALSE;
+    return;
+  }
+
+  pty = vte_pty_new_sync (VTE_PTY_DEFAULT, NULL, &error);
+  if (pty == NULL) {
+    deap_warn_msg ("Error creating PTY: %s", error->message);
+    warm_shell.spawning = FALSE;
+    return;
+  }
+
+  vte_pty_set_size (pty, 24, 80, NULL);
+
+  command[0] = shell;
+  vte_pty_spawn_async (pty,
+                       NULL,
+                       command,
+                       NULL,
+                       G_SPAWN_DEFAULT,
+                       NULL, NULL, NULL,
+                       -1,
+                       NULL,
+                       warm_shell_spawned_cb,
+                       NULL);
+}
 
-  command[0] = vte_get_user_shell ();
+static gboolean
+take_warm_shell (VtePty **pty,
+                 GPid    *pid)
+{
+  if (warm_shell.pty == NULL)
+    return FALSE;
+
+  /* The terminal watches it from now on */
+  if (warm_shell.child_watch_id) {
+    g_source_remove (warm_shell.child_watch_id);
+    warm_shell.child_watch_id = 0;
+  }
+
+  *pty = g_steal_pointer (&warm_shell.pty);
+  *pid = warm_shell.pid;
+  warm_shell.pid = -1;
+
+  return TRUE;
+}
+/* --- End of Warm Shell --- */
+
+
+static void
+terminal_spawned_cb (VteTerminal *terminal,
+                     GPid         pid,
+                     GError      *error,
+                     gpointer     user_data)
+{
+  if (error)
+    deap_warn_msg ("Error spawning shell: %s", error->message);
+
+  deap_profile_page_populated ("virtual-terminal");
+}
+
+static void
+terminal_shell_resolved_cb (GObject      *source,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+  DeapVirtualTerminal *self;
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *shell = NULL;
+  gchar *command[2] = { NULL };
+
+  shell = resolve_user_shell_finish (res, &error);
+  if (shell == NULL) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      deap_warn_msg ("Error resolving user shell: %s", error->message);
+      deap_profile_page_populated ("virtual-terminal");
+    }
+    return;
+  }
+
+  self = DEAP_VIRTUAL_TERMINAL (user_data);
+
+  command[0] = shell;
   vte_terminal_spawn_async (VTE_TERMINAL (self->terminal),
                             VTE_PTY_DEFAULT,
                             NULL,
@@ -51,33 +312,424 @@ internal_spawn_terminal (DeapVirtualTerminal *self)
                             NULL,
                             G_SPAWN_DEFAULT,
                             NULL, NULL, NULL,
-                            5000,
-                            NULL,
-                            NULL,
+                            -1,
+                            self->cancellable,
+                            terminal_spawned_cb,
                             NULL);
+}
+
+static void
+internal_spawn_terminal (DeapVirtualTerminal *self)
+{
+  VtePty *pty = NULL;
+  GPid pid;
+
+  DEAP_TRACE_ENTRY;
+
+  deap_metrics_counter_add ("terminal.spawns", 1);
+
+  if (take_warm_shell (&pty, &pid)) {
+    deap_trace_msg ("Attaching warm shell, pid %d", pid);
+
+    vte_terminal_set_pty (VTE_TERMINAL (self->terminal), pty);
+    vte_terminal_watch_child (VTE_TERMINAL (self->terminal), pid);
+    g_object_unref (pty);
+
+    deap_profile_page_populated ("virtual-terminal");
+
+    /* Keep another one ready for the next respawn, see map() */
+    if (gtk_widget_get_mapped (GTK_WIDGET (self)))
+      deap_virtual_terminal_prewarm ();
+  } else {
+    resolve_user_shell_async (self->cancellable,
+                              terminal_shell_resolved_cb,
+                              self);
+  }
 
   DEAP_TRACE_EXIT;
 }
 
+/* --- Respawn Limiter --- */
+static void
+refill_respawn_tokens (DeapVirtualTerminal *self)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  self->respawn_tokens += (gdouble) (now - self->respawn_refilled_at) / RESPAWN_REFILL_USEC;
+  self->respawn_refilled_at = now;
+
+  if (self->respawn_tokens >= RESPAWN_BURST) {
+    self->respawn_tokens = RESPAWN_BURST;
+    self->respawn_backoff_msec = 0;
+    self->n_suppressed = 0;
+  }
+}
+
+/* @status is a wait status, as VteTerminal::child-exited hands it over */
+static gchar *
+describe_exit_status (gint status)
+{
+  if (WIFEXITED (status))
+    return g_strdup_printf (_("The shell exited with status %d."), WEXITSTATUS (status));
+
+  if (WIFSIGNALED (status))
+    return g_strdup_printf (_("The shell was killed by signal %d (%s)."),
+                            WTERMSIG (status), g_strsignal (WTERMSIG (status)));
+
+  return g_strdup_printf (_("The shell exited with wait status %d."), status);
+}
+
+static void
+show_status (DeapVirtualTerminal *self,
+             const gchar         *text)
+{
+  if (text != NULL)
+    gtk_label_set_text (GTK_LABEL (self->status_label), text);
+
+  gtk_revealer_set_reveal_child (GTK_REVEALER (self->status_revealer), text != NULL);
+}
+
+static gboolean
+respawn_timeout_cb (gpointer user_data)
+{
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (user_data);
+
+  self->respawn_source_id = 0;
+
+  refill_respawn_tokens (self);
+  self->respawn_tokens = MAX (0, self->respawn_tokens - 1);
+
+  /* The countdown is over; should this shell die too, its exit says so */
+  show_status (self, NULL);
+
+  deap_metrics_counter_add ("terminal.respawns", 1);
+  internal_spawn_terminal (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * internal_respawn_terminal_cb
+ *
+ * A shell which fails right away, e.g. on a broken rc file, would be
+ * respawned in a tight fork/exec loop, so respawns go through a token
+ * bucket (see RESPAWN_BURST). The exit status, and the crash-loop state
+ * with the number of respawns put off so far, is shown above the
+ * terminal.
+ */
 static void
 internal_respawn_terminal_cb (VteTerminal *vteterminal,
                               gint         status,
                               gpointer     user_data)
 {
   DeapVirtualTerminal *self;
+  g_autofree gchar *exit_text = NULL;
+  g_autofree gchar *text = NULL;
 
   DEAP_TRACE_ENTRY;
 
   self = DEAP_VIRTUAL_TERMINAL (user_data);
-  internal_spawn_terminal (self);
+
+  exit_text = describe_exit_status (status);
+  deap_debug_msg ("%s", exit_text);
+
+  refill_respawn_tokens (self);
+
+  if (self->respawn_tokens >= 1) {
+    self->respawn_tokens -= 1;
+
+    /* A plain "exit" is nothing to report */
+    show_status (self, WIFEXITED (status) && WEXITSTATUS (status) == 0 ? NULL : exit_text);
+
+    deap_metrics_counter_add ("terminal.respawns", 1);
+    internal_spawn_terminal (self);
+
+    DEAP_TRACE_EXIT;
+    return;
+  }
+
+  /* Not expected without a child, but never stack timeouts */
+  if (self->respawn_source_id) {
+    DEAP_TRACE_EXIT;
+    return;
+  }
+
+  if (self->respawn_backoff_msec == 0)
+    self->respawn_backoff_msec = RESPAWN_BACKOFF_MIN_MSEC;
+  else
+    self->respawn_backoff_msec = MIN (self->respawn_backoff_msec * 2, RESPAWN_BACKOFF_MAX_MSEC);
+
+  self->n_suppressed++;
+  deap_metrics_counter_add ("terminal.respawns.suppressed", 1);
+
+  deap_debug_msg ("Shell is crash-looping, respawning in %u ms", self->respawn_backoff_msec);
+
+  text = g_strdup_printf (ngettext ("%s It keeps exiting, so it is respawned in %u s; %u respawn was put off so far.",
+                                    "%s It keeps exiting, so it is respawned in %u s; %u respawns were put off so far.",
+                                    self->n_suppressed),
+                          exit_text, (self->respawn_backoff_msec + 999) / 1000, self->n_suppressed);
+  show_status (self, text);
+
+  self->respawn_source_id = g_timeout_add (self->respawn_backoff_msec, respawn_timeout_cb, self);
 
   DEAP_TRACE_EXIT;
 }
+/* --- End of Respawn Limiter --- */
+
+/* --- Scrollback Search --- */
+static void
+cached_regex_free (gpointer data)
+{
+  CachedRegex *cached = data;
+
+  g_free (cached->key);
+  vte_regex_unref (cached->regex);
+  g_free (cached);
+}
+
+/*
+ * lookup_search_regex
+ *
+ * Compiling and JIT-compiling a pattern costs more than searching a
+ * screenful, and incremental search goes back and forth over the same
+ * patterns, so the last REGEX_CACHE_SIZE are kept.
+ *
+ * Returns: (transfer full) (nullable): the regex, JIT-compiled if PCRE2
+ * could
+ */
+static VteRegex *
+lookup_search_regex (DeapVirtualTerminal  *self,
+                     const gchar          *pattern,
+                     guint32               flags,
+                     GError              **error)
+{
+  g_autoptr(GError) jit_error = NULL;
+  g_autofree gchar *key = NULL;
+  CachedRegex *cached;
+  VteRegex *regex;
+  GList *link;
+  gint64 begin;
+
+  key = g_strdup_printf ("%08x:%s", flags, pattern);
+
+  link = g_hash_table_lookup (self->regex_cache, key);
+  if (link != NULL) {
+    g_queue_unlink (&self->regex_lru, link);
+    g_queue_push_head_link (&self->regex_lru, link);
+
+    cached = link->data;
+    return vte_regex_ref (cached->regex);
+  }
+
+  begin = g_get_monotonic_time ();
+
+  regex = vte_regex_new_for_search (pattern, -1, flags, error);
+  if (regex == NULL)
+    return NULL;
+
+  /* Only an optimization: without it, matching is interpreted */
+  if (!vte_regex_jit (regex, PCRE2_JIT_COMPLETE, &jit_error))
+    deap_debug_msg ("No JIT for /%s/: %s", pattern, jit_error->message);
+
+  deap_metrics_histogram_record ("terminal.search.compile", g_get_monotonic_time () - begin);
+
+  cached = g_new0 (CachedRegex, 1);
+  cached->key = g_steal_pointer (&key);
+  cached->regex = vte_regex_ref (regex);
+
+  g_queue_push_head (&self->regex_lru, cached);
+  g_hash_table_insert (self->regex_cache, cached->key, self->regex_lru.head);
+
+  if (self->regex_lru.length > REGEX_CACHE_SIZE) {
+    cached = g_queue_pop_tail (&self->regex_lru);
+    g_hash_table_remove (self->regex_cache, cached->key);
+    cached_regex_free (cached);
+  }
+
+  return regex;
+}
+
+static void
+set_search_error (DeapVirtualTerminal *self,
+                  gboolean             failed,
+                  const gchar         *message)
+{
+  GtkStyleContext *context = gtk_widget_get_style_context (self->search_entry);
+
+  if (failed)
+    gtk_style_context_add_class (context, GTK_STYLE_CLASS_ERROR);
+  else
+    gtk_style_context_remove_class (context, GTK_STYLE_CLASS_ERROR);
+
+  gtk_widget_set_tooltip_text (self->search_entry, message);
+}
+
+/*
+ * search_terminal
+ *
+ * VTE carries on from the current selection, i.e. the previous match,
+ * so stepping through matches never rescans what was already passed;
+ * without a selection it starts from the end of the buffer.
+ * The match found is selected, which is what highlights it.
+ */
+static void
+search_terminal (DeapVirtualTerminal *self,
+                 gboolean             backward)
+{
+  VteTerminal *terminal = VTE_TERMINAL (self->terminal);
+  gboolean found;
+  gint64 begin;
+
+  if (vte_terminal_search_get_regex (terminal) == NULL)
+    return;
+
+  begin = g_get_monotonic_time ();
+
+  if (backward)
+    found = vte_terminal_search_find_previous (terminal);
+  else
+    found = vte_terminal_search_find_next (terminal);
+
+  deap_metrics_histogram_record ("terminal.search.find", g_get_monotonic_time () - begin);
+
+  set_search_error (self, !found, found ? NULL : _("No match"));
+}
+
+/*
+ * on_search_changed_cb
+ *
+ * GtkSearchEntry already waits for typing to pause. Patterns without
+ * upper case letters match case-insensitively, and the search runs
+ * from the bottom up, where the latest output is.
+ */
+static void
+on_search_changed_cb (GtkSearchEntry *entry,
+                      gpointer        user_data)
+{
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (user_data);
+  VteTerminal *terminal = VTE_TERMINAL (self->terminal);
+  g_autoptr(GError) error = NULL;
+  const gchar *pattern;
+  const gchar *p;
+  guint32 flags = SEARCH_COMPILE_FLAGS | PCRE2_CASELESS;
+  VteRegex *regex;
+
+  pattern = gtk_entry_get_text (GTK_ENTRY (entry));
+
+  if (*pattern == '\0') {
+    vte_terminal_search_set_regex (terminal, NULL, 0);
+    vte_terminal_unselect_all (terminal);
+    set_search_error (self, FALSE, NULL);
+    return;
+  }
+
+  for (p = pattern; *p != '\0'; p = g_utf8_next_char (p)) {
+    if (g_unichar_isupper (g_utf8_get_char (p))) {
+      flags &= ~PCRE2_CASELESS;
+      break;
+    }
+  }
+
+  regex = lookup_search_regex (self, pattern, flags, &error);
+  if (regex == NULL) {
+    vte_terminal_search_set_regex (terminal, NULL, 0);
+    set_search_error (self, TRUE, error->message);
+    return;
+  }
+
+  vte_terminal_search_set_regex (terminal, regex, 0);
+  vte_regex_unref (regex);
+
+  /*
+   * VTE would carry on from the previous pattern's match, and refining
+   * "err" to "erro" would skip the "error" containing it
+   */
+  vte_terminal_unselect_all (terminal);
+  search_terminal (self, TRUE);
+}
+
+static void
+on_search_previous_cb (GtkWidget *widget,
+                       gpointer   user_data)
+{
+  search_terminal (DEAP_VIRTUAL_TERMINAL (user_data), TRUE);
+}
+
+static void
+on_search_next_cb (GtkWidget *widget,
+                   gpointer   user_data)
+{
+  search_terminal (DEAP_VIRTUAL_TERMINAL (user_data), FALSE);
+}
+
+static void
+on_stop_search_cb (GtkSearchEntry *entry,
+                   gpointer        user_data)
+{
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (user_data);
+
+  gtk_search_bar_set_search_mode (GTK_SEARCH_BAR (self->search_bar), FALSE);
+  gtk_widget_grab_focus (self->terminal);
+}
+
+/* Ctrl+Shift+F, as in other terminals; plain Ctrl+F belongs to the shell */
+static gboolean
+on_terminal_key_press_cb (GtkWidget   *widget,
+                          GdkEventKey *event,
+                          gpointer     user_data)
+{
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (user_data);
+  GdkModifierType mods = event->state & gtk_accelerator_get_default_mod_mask ();
+
+  if (mods != (GDK_CONTROL_MASK | GDK_SHIFT_MASK) ||
+      gdk_keyval_to_lower (event->keyval) != GDK_KEY_f)
+    return GDK_EVENT_PROPAGATE;
+
+  gtk_search_bar_set_search_mode (GTK_SEARCH_BAR (self->search_bar), TRUE);
+  gtk_widget_grab_focus (self->search_entry);
+
+  return GDK_EVENT_STOP;
+}
+/* --- End of Scrollback Search --- */
 
 /* --- GObject --- */
+/*
+ * The spare shell is only worth its fork once the page is in use: a
+ * page built ahead of time by the window's prefetch does not get one.
+ */
+static void
+deap_virtual_terminal_map (GtkWidget *widget)
+{
+  GTK_WIDGET_CLASS (deap_virtual_terminal_parent_class)->map (widget);
+
+  deap_virtual_terminal_prewarm ();
+}
+
+static void
+deap_virtual_terminal_dispose (GObject *object)
+{
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (object);
+
+  if (self->respawn_source_id) {
+    g_source_remove (self->respawn_source_id);
+    self->respawn_source_id = 0;
+  }
+
+  G_OBJECT_CLASS (deap_virtual_terminal_parent_class)->dispose (object);
+}
+
 static void
 deap_virtual_terminal_finalize (GObject *object)
 {
+  DeapVirtualTerminal *self = DEAP_VIRTUAL_TERMINAL (object);
+
+  g_cancellable_cancel (self->cancellable);
+  g_clear_object (&self->cancellable);
+
+  g_clear_pointer (&self->regex_cache, g_hash_table_unref);
+  g_queue_foreach (&self->regex_lru, (GFunc) cached_regex_free, NULL);
+  g_queue_clear (&self->regex_lru);
+
   G_OBJECT_CLASS (deap_virtual_terminal_parent_class)->finalize (object);
 }
 static void
@@ -86,25 +738,53 @@ deap_virtual_terminal_class_init (DeapVirtualTerminalClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = deap_virtual_terminal_dispose;
   object_class->finalize = deap_virtual_terminal_finalize;
 
+  widget_class->map = deap_virtual_terminal_map;
+
   gtk_widget_class_set_template_from_resource (widget_class, "/com/github/memnoth/Deap/deap-virtual-terminal.ui");
 
   gtk_widget_class_bind_template_child (widget_class, DeapVirtualTerminal, main_box);
+  gtk_widget_class_bind_template_child (widget_class, DeapVirtualTerminal, status_revealer);
+  gtk_widget_class_bind_template_child (widget_class, DeapVirtualTerminal, status_label);
+  gtk_widget_class_bind_template_child (widget_class, DeapVirtualTerminal, search_bar);
+  gtk_widget_class_bind_template_child (widget_class, DeapVirtualTerminal, search_entry);
+  gtk_widget_class_bind_template_callback (widget_class, on_search_changed_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_search_previous_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_search_next_cb);
+  gtk_widget_class_bind_template_callback (widget_class, on_stop_search_cb);
 }
 
 static void
 deap_virtual_terminal_init (DeapVirtualTerminal *self)
 {
+  DEAP_TRACE_SCOPE (G_STRFUNC);
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->cancellable = g_cancellable_new ();
+
+  self->respawn_tokens = RESPAWN_BURST;
+  self->respawn_refilled_at = g_get_monotonic_time ();
+
+  g_queue_init (&self->regex_lru);
+  self->regex_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
   self->terminal = vte_terminal_new ();
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (self->terminal), SCROLLBACK_LINES);
+  vte_terminal_search_set_wrap_around (VTE_TERMINAL (self->terminal), TRUE);
   internal_spawn_terminal (self);
   g_signal_connect (self->terminal,
                     "child-exited",
                     G_CALLBACK (internal_respawn_terminal_cb),
                     self);
+  g_signal_connect (self->terminal,
+                    "key-press-event",
+                    G_CALLBACK (on_terminal_key_press_cb),
+                    self);
+
+  gtk_search_bar_connect_entry (GTK_SEARCH_BAR (self->search_bar), GTK_ENTRY (self->search_entry));
 
   gtk_container_add (GTK_CONTAINER (self->main_box), self->terminal);
   gtk_widget_show_all (self->main_box);
@@ -128,3 +808,20 @@ deap_virtual_terminal_get_instance (void)
 
   return instance;
 }
+
+/*
+ * deap_virtual_terminal_prewarm
+ *
+ * Resolves the user shell on a worker thread and keeps one spawned
+ * PTY + shell around, so the next (re)spawn only has to attach it.
+ * Called as the terminal page gets mapped, never ahead of it.
+ */
+void
+deap_virtual_terminal_prewarm (void)
+{
+  if (warm_shell.pty != NULL || warm_shell.spawning)
+    return;
+
+  warm_shell.spawning = TRUE;
+  resolve_user_shell_async (NULL, warm_shell_resolved_cb, NULL);
+}
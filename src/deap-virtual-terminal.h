@@ -29,5 +29,6 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (DeapVirtualTerminal, deap_virtual_terminal, DEAP, VIRTUAL_TERMINAL, GtkBox)
 
 GtkWidget *     deap_virtual_terminal_get_instance (void);
+void            deap_virtual_terminal_prewarm      (void);
 
 G_END_DECLS
@@ -17,10 +17,14 @@
  */
 
 #include "deap-config.h"
+#include "deap-debug.h"
 #include "deap-window.h"
 
+#include "deap-command-palette.h"
+#include "deap-diagnostics.h"
 #include "deap-gnome-shell.h"
 #include "deap-login1.h"
+#include "deap-profile.h"
 #include "deap-virtual-terminal.h"
 
 struct _DeapWindow
@@ -31,6 +35,12 @@ struct _DeapWindow
   GtkHeaderBar        *header_bar;
 
   GtkWidget           *prefs_view;
+  GtkWidget           *command_palette;
+
+  struct _PrefsPage   *pages;
+  gsize                n_pages;
+  guint                prefetch_source_id;
+  gboolean             prefetch_pages;
 };
 
 typedef struct
@@ -38,45 +48,242 @@ typedef struct
   const gchar *title;
   const gchar *description;
   const gchar *page_name;
-  GtkWidget   *widget;
+  GtkWidget   *(*get_instance) (void);
 } PrefsItem;
 
+/*
+ * Every page is registered as an empty placeholder box. The real widget,
+ * and with it all of its D-Bus and PTY work, is only created the first
+ * time the placeholder gets mapped.
+ */
+typedef struct _PrefsPage
+{
+  const PrefsItem *item;
+  GtkWidget       *placeholder;
+  GtkWidget       *widget;
+} PrefsPage;
+
+enum {
+  PROP_0,
+  PROP_PREFETCH_PAGES,
+  N_PROPS
+};
+
+static GParamSpec *properties [N_PROPS];
+
+/* title, description, page_name, get_instance */
+static const PrefsItem item_table[] = {
+    { "org.gnome.Shell", "", "gnome-shell", deap_gnome_shell_get_instance },
+    { "org.freedesktop.login1", "", "freedesktop-login1", deap_login1_get_instance },
+    { "Virtual Terminal", "", "virtual-terminal", deap_virtual_terminal_get_instance },
+    { "Diagnostics", "", "diagnostics", deap_diagnostics_get_instance },
+    { NULL }
+};
+
 G_DEFINE_TYPE (DeapWindow, deap_window, GTK_TYPE_APPLICATION_WINDOW)
 
 
 static void
-add_preferences (DzlPreferences  *prefs,
+ensure_page_widget (PrefsPage *page)
+{
+  DEAP_TRACE_SCOPE (G_STRFUNC);
+
+  if (page->widget != NULL)
+    return;
+
+  page->widget = page->item->get_instance ();
+  gtk_box_pack_start (GTK_BOX (page->placeholder), page->widget, TRUE, TRUE, 0);
+  gtk_widget_show (page->widget);
+}
+
+static gboolean
+prefetch_next_page_cb (gpointer user_data)
+{
+  DeapWindow *self = DEAP_WINDOW (user_data);
+  gsize i;
+
+  /* Build the first page which is not built yet, one per idle */
+  for (i = 0; i < self->n_pages; i++) {
+    if (self->pages[i].widget == NULL) {
+      ensure_page_widget (&self->pages[i]);
+      break;
+    }
+  }
+
+  /* Startup profiling measures every page, so keep going until all are built */
+  if (deap_profile_is_enabled () && i + 1 < self->n_pages)
+    return G_SOURCE_CONTINUE;
+
+  self->prefetch_source_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+on_page_placeholder_map_cb (GtkWidget *placeholder,
+                            gpointer   user_data)
+{
+  DeapWindow *self = DEAP_WINDOW (user_data);
+  PrefsPage *page;
+  gsize idx;
+
+  idx = GPOINTER_TO_SIZE (g_object_get_data (G_OBJECT (placeholder), "page-index"));
+  page = &self->pages[idx];
+
+  ensure_page_widget (page);
+
+  /*
+   * Warm up the next page while the user is looking at this one. Off
+   * by default: building a page starts its D-Bus or PTY work, which is
+   * what building pages lazily saves at startup.
+   */
+  if ((self->prefetch_pages || deap_profile_is_enabled ()) &&
+      self->prefetch_source_id == 0 &&
+      idx + 1 < self->n_pages &&
+      self->pages[idx + 1].widget == NULL) {
+    self->prefetch_source_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                prefetch_next_page_cb,
+                                                self,
+                                                NULL);
+  }
+}
+
+static void
+add_preferences (DeapWindow      *self,
                  const PrefsItem *items)
 {
+  DzlPreferences *prefs = DZL_PREFERENCES (self->prefs_view);
   gsize i;
 
-  for (i = 0; items[i].title; i++) {
+  for (self->n_pages = 0; items[self->n_pages].title; self->n_pages++)
+    ;
+
+  self->pages = g_new0 (PrefsPage, self->n_pages);
+  deap_profile_expect_pages (self->n_pages);
+
+  for (i = 0; i < self->n_pages; i++) {
+    PrefsPage *page = &self->pages[i];
+
+    page->item = &items[i];
+    page->placeholder = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+    g_object_set_data (G_OBJECT (page->placeholder), "page-index", GSIZE_TO_POINTER (i));
+    g_signal_connect (page->placeholder,
+                      "map",
+                      G_CALLBACK (on_page_placeholder_map_cb),
+                      self);
+    gtk_widget_show (page->placeholder);
+
     dzl_preferences_add_page (prefs, items[i].page_name, items[i].title, i);
     dzl_preferences_add_group (prefs, items[i].page_name, "basic", NULL, i);
-    dzl_preferences_add_custom (prefs, items[i].page_name, "basic", items[i].widget, NULL, 0);
+    dzl_preferences_add_custom (prefs, items[i].page_name, "basic", page->placeholder, NULL, 0);
   }
 
   dzl_preferences_set_page (prefs, items[0].page_name, NULL);
 }
 
+static void
+show_command_palette_cb (GSimpleAction *action,
+                         GVariant      *parameter,
+                         gpointer       user_data)
+{
+  DeapWindow *self = DEAP_WINDOW (user_data);
+
+  /* Built on first use, it indexes every page */
+  if (self->command_palette == NULL)
+    self->command_palette = deap_command_palette_new (GTK_WIDGET (self->header_bar));
+
+  gtk_popover_popup (GTK_POPOVER (self->command_palette));
+}
+
+static void
+add_actions (DeapWindow *self)
+{
+  g_autoptr(GSimpleAction) action = NULL;
+
+  action = g_simple_action_new ("command-palette", NULL);
+  g_signal_connect (action, "activate", G_CALLBACK (show_command_palette_cb), self);
+  g_action_map_add_action (G_ACTION_MAP (self), G_ACTION (action));
+}
+
 /* --- GObject --- */
+static void
+deap_window_get_property (GObject    *object,
+                          guint       prop_id,
+                          GValue     *value,
+                          GParamSpec *pspec)
+{
+  DeapWindow *self = DEAP_WINDOW (object);
+
+  switch (prop_id) {
+    case PROP_PREFETCH_PAGES:
+      g_value_set_boolean (value, self->prefetch_pages);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
+static void
+deap_window_set_property (GObject      *object,
+                          guint         prop_id,
+                          const GValue *value,
+                          GParamSpec   *pspec)
+{
+  DeapWindow *self = DEAP_WINDOW (object);
+
+  switch (prop_id) {
+    case PROP_PREFETCH_PAGES:
+      self->prefetch_pages = g_value_get_boolean (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+  }
+}
+
 static void
 deap_window_dispose (GObject *object)
 {
   DeapWindow *self = DEAP_WINDOW (object);
 
-  (void)self;
+  if (self->prefetch_source_id) {
+    g_source_remove (self->prefetch_source_id);
+    self->prefetch_source_id = 0;
+  }
 
   G_OBJECT_CLASS (deap_window_parent_class)->dispose (object);
 }
 
+static void
+deap_window_finalize (GObject *object)
+{
+  DeapWindow *self = DEAP_WINDOW (object);
+
+  g_clear_pointer (&self->pages, g_free);
+
+  G_OBJECT_CLASS (deap_window_parent_class)->finalize (object);
+}
+
 static void
 deap_window_class_init (DeapWindowClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->get_property = deap_window_get_property;
+  object_class->set_property = deap_window_set_property;
   object_class->dispose = deap_window_dispose;
+  object_class->finalize = deap_window_finalize;
+
+  properties [PROP_PREFETCH_PAGES] =
+    g_param_spec_boolean ("prefetch-pages",
+                          "Prefetch pages",
+                          "Build the next page in idle time once a page is shown",
+                          FALSE,
+                          (G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_properties (object_class, N_PROPS, properties);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/com/github/memnoth/Deap/deap-window.ui");
   gtk_widget_class_bind_template_child (widget_class, DeapWindow, header_bar);
@@ -88,19 +295,8 @@ deap_window_init (DeapWindow *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
 
-  /* title, description, page_name, widget */
-  static PrefsItem item_table[] = {
-      { "org.gnome.Shell", "", "gnome-shell", NULL },
-      { "org.freedesktop.login1", "", "freedesktop-login1", NULL },
-      { "Virtual Terminal", "", "virtual-terminal", NULL },
-      { NULL }
-  };
-
-  item_table[0].widget = deap_gnome_shell_get_instance ();
-  item_table[1].widget = deap_login1_get_instance ();
-  item_table[2].widget = deap_virtual_terminal_get_instance ();
-
-  add_preferences (DZL_PREFERENCES (self->prefs_view), item_table);
+  add_preferences (self, item_table);
+  add_actions (self);
 }
 
 GtkWidget *
@@ -110,3 +306,13 @@ deap_window_new (DeapApplication *application)
                                    "application", application,
                                    NULL));
 }
+
+void
+deap_window_show_page (DeapWindow  *self,
+                       const gchar *page_name)
+{
+  g_return_if_fail (DEAP_IS_WINDOW (self));
+  g_return_if_fail (page_name != NULL);
+
+  dzl_preferences_set_page (DZL_PREFERENCES (self->prefs_view), page_name, NULL);
+}
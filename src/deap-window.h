@@ -28,6 +28,9 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (DeapWindow, deap_window, DEAP, WINDOW, GtkApplicationWindow)
 
-GtkWidget *       deap_window_new     (DeapApplication *self);
+GtkWidget *       deap_window_new         (DeapApplication *self);
+
+void              deap_window_show_page   (DeapWindow      *self,
+                                           const gchar     *page_name);
 
 G_END_DECLS
@@ -0,0 +1,306 @@
+/* deap-flight-recorder.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapFlightRecorder"
+
+#include "deap-debug.h"
+#include "deap-flight-recorder.h"
+#include "gtd-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+/*
+ * Flight recorder
+ *
+ * Every log record, whether or not --debug was given, is also copied as
+ * a fixed-size binary record into a ring which lives in a shared mmap of
+ * $XDG_RUNTIME_DIR/deap/flight-recorder.ring. The kernel owns the pages,
+ * so the last records survive a crash of the process. The ring of the
+ * previous session is kept as flight-recorder.ring.old.
+ *
+ * Appending claims an index with one atomic add and publishes the record
+ * by storing its sequence number last, so a torn record is recognizable
+ * and skipped when decoding.
+ */
+
+#define FLIGHT_RECORDER_MAGIC        "DEAPFR01"
+#define FLIGHT_RECORDER_VERSION      1
+#define FLIGHT_RECORDER_N_RECORDS    8192    /* Must be a power of two */
+#define FLIGHT_RECORDER_HEADER_SIZE  4096
+#define FLIGHT_RECORDER_DOMAIN_MAX   24
+#define FLIGHT_RECORDER_MESSAGE_MAX  216
+
+typedef struct
+{
+  gchar          magic[8];
+  guint32        version;
+  guint32        record_size;
+  guint32        n_records;
+  guint32        pid;
+  gint64         start_time;
+  volatile gint  head;
+  volatile gint  clean_exit;
+} FlightRecorderHeader;
+
+typedef struct
+{
+  volatile gint  sequence;
+  guint32        log_level;
+  gint64         real_time;
+  gchar          domain[FLIGHT_RECORDER_DOMAIN_MAX];
+  gchar          message[FLIGHT_RECORDER_MESSAGE_MAX];
+} FlightRecord;
+
+G_STATIC_ASSERT (sizeof (FlightRecorderHeader) <= FLIGHT_RECORDER_HEADER_SIZE);
+G_STATIC_ASSERT (sizeof (FlightRecord) == 256);
+
+static FlightRecorderHeader *header = NULL;
+static FlightRecord *records = NULL;
+static gsize mapping_size = 0;
+
+static GLogFunc previous_handler = NULL;
+static gpointer previous_handler_data = NULL;
+
+
+static gsize
+get_mapping_size (guint32 n_records)
+{
+  return FLIGHT_RECORDER_HEADER_SIZE + (gsize) n_records * sizeof (FlightRecord);
+}
+
+static void
+copy_truncated (gchar       *dest,
+                gsize        dest_size,
+                const gchar *src)
+{
+  gsize len;
+
+  if (src == NULL)
+    src = "";
+
+  len = strnlen (src, dest_size - 1);
+  memcpy (dest, src, len);
+  dest[len] = '\0';
+}
+
+void
+deap_flight_recorder_append (const gchar    *domain,
+                             GLogLevelFlags  log_level,
+                             const gchar    *message)
+{
+  FlightRecord *record;
+  guint idx;
+
+  if (header == NULL)
+    return;
+
+  idx = (guint) g_atomic_int_add (&header->head, 1);
+  record = &records[idx & (FLIGHT_RECORDER_N_RECORDS - 1)];
+
+  /* Invalidate while the record is rewritten */
+  g_atomic_int_set (&record->sequence, 0);
+
+  record->log_level = log_level;
+  record->real_time = g_get_real_time ();
+  copy_truncated (record->domain, sizeof (record->domain), domain);
+  copy_truncated (record->message, sizeof (record->message), message);
+
+  g_atomic_int_set (&record->sequence, (gint) (idx + 1));
+}
+
+static void
+flight_recorder_log_handler (const gchar    *domain,
+                             GLogLevelFlags  log_level,
+                             const gchar    *message,
+                             gpointer        user_data)
+{
+  deap_flight_recorder_append (domain, log_level, message);
+
+  if (previous_handler != NULL)
+    previous_handler (domain, log_level, message, previous_handler_data);
+}
+
+static gchar *
+get_ring_path (void)
+{
+  return g_build_filename (g_get_user_runtime_dir (), "deap", "flight-recorder.ring", NULL);
+}
+
+gboolean
+deap_flight_recorder_init (GError **error)
+{
+  g_autofree gchar *path = NULL;
+  g_autofree gchar *old_path = NULL;
+  g_autofree gchar *dir = NULL;
+  gpointer mapping;
+  gint fd;
+
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  if (header != NULL)
+    return TRUE;
+
+  path = get_ring_path ();
+  dir = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dir, 0700) < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Could not create %s: %s", dir, g_strerror (errno));
+    return FALSE;
+  }
+
+  /* Keep what the previous session recorded, it might have crashed */
+  old_path = g_strconcat (path, ".old", NULL);
+  g_rename (path, old_path);
+
+  mapping_size = get_mapping_size (FLIGHT_RECORDER_N_RECORDS);
+
+  fd = g_open (path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Could not open %s: %s", path, g_strerror (errno));
+    return FALSE;
+  }
+
+  if (ftruncate (fd, mapping_size) < 0) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Could not resize %s: %s", path, g_strerror (errno));
+    close (fd);
+    return FALSE;
+  }
+
+  mapping = mmap (NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (mapping == MAP_FAILED) {
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Could not map %s: %s", path, g_strerror (errno));
+    return FALSE;
+  }
+
+  header = mapping;
+  records = (FlightRecord *) ((gchar *) mapping + FLIGHT_RECORDER_HEADER_SIZE);
+
+  memcpy (header->magic, FLIGHT_RECORDER_MAGIC, sizeof (header->magic));
+  header->version = FLIGHT_RECORDER_VERSION;
+  header->record_size = sizeof (FlightRecord);
+  header->n_records = FLIGHT_RECORDER_N_RECORDS;
+  header->pid = getpid ();
+  header->start_time = g_get_real_time ();
+
+  previous_handler = g_log_set_default_handler (flight_recorder_log_handler, NULL);
+
+  return TRUE;
+}
+
+void
+deap_flight_recorder_shutdown (void)
+{
+  if (header == NULL)
+    return;
+
+  g_atomic_int_set (&header->clean_exit, 1);
+  msync (header, mapping_size, MS_ASYNC);
+}
+
+gboolean
+deap_flight_recorder_dump (const gchar  *path,
+                           gint          fd,
+                           GError      **error)
+{
+  g_autoptr(GMappedFile) file = NULL;
+  const FlightRecorderHeader *ring_header;
+  const FlightRecord *ring;
+  gchar line[1024];
+  gsize length;
+  guint head;
+  guint first;
+  guint i;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  file = g_mapped_file_new (path, FALSE, error);
+  if (file == NULL)
+    return FALSE;
+
+  length = g_mapped_file_get_length (file);
+  ring_header = (const FlightRecorderHeader *) g_mapped_file_get_contents (file);
+
+  if (length < FLIGHT_RECORDER_HEADER_SIZE ||
+      memcmp (ring_header->magic, FLIGHT_RECORDER_MAGIC, sizeof (ring_header->magic)) != 0 ||
+      ring_header->version != FLIGHT_RECORDER_VERSION ||
+      ring_header->record_size != sizeof (FlightRecord) ||
+      ring_header->n_records == 0 ||
+      (ring_header->n_records & (ring_header->n_records - 1)) != 0 ||
+      length < get_mapping_size (ring_header->n_records)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                 "%s is not a deap flight recorder ring", path);
+    return FALSE;
+  }
+
+  ring = (const FlightRecord *) ((const gchar *) ring_header + FLIGHT_RECORDER_HEADER_SIZE);
+
+  head = (guint) ring_header->head;
+  first = head > ring_header->n_records ? head - ring_header->n_records : 0;
+
+  length = g_snprintf (line, sizeof (line),
+                       "# deap flight recorder, pid %u, %u records, %s\n",
+                       ring_header->pid,
+                       head - first,
+                       ring_header->clean_exit ? "exited cleanly" : "did not exit cleanly");
+  if (write (fd, line, length) < 0)
+    goto write_error;
+
+  for (i = first; i != head; i++) {
+    const FlightRecord *record = &ring[i & (ring_header->n_records - 1)];
+    gchar domain[FLIGHT_RECORDER_DOMAIN_MAX];
+    gchar message[FLIGHT_RECORDER_MESSAGE_MAX];
+
+    /* Never published, or torn by the crash */
+    if ((guint) record->sequence != i + 1)
+      continue;
+
+    copy_truncated (domain, sizeof (domain), record->domain);
+    copy_truncated (message, sizeof (message), record->message);
+
+    length = gtd_log_format_line (line, sizeof (line),
+                                  record->real_time,
+                                  domain,
+                                  record->log_level,
+                                  message);
+    if (write (fd, line, length) < 0)
+      goto write_error;
+  }
+
+  return TRUE;
+
+write_error:
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+               "Could not write the decoded records: %s", g_strerror (errno));
+  return FALSE;
+}
@@ -0,0 +1,39 @@
+/* deap-flight-recorder.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean             deap_flight_recorder_init                  (GError        **error);
+
+void                 deap_flight_recorder_shutdown              (void);
+
+void                 deap_flight_recorder_append                (const gchar    *domain,
+                                                                 GLogLevelFlags  log_level,
+                                                                 const gchar    *message);
+
+gboolean             deap_flight_recorder_dump                  (const gchar    *path,
+                                                                 gint            fd,
+                                                                 GError        **error);
+
+G_END_DECLS
@@ -0,0 +1,264 @@
+/* deap-trace.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "DeapTrace"
+
+#include "deap-debug.h"
+#include "deap-json.h"
+#include "deap-trace.h"
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Events are kept in memory until exit, so a long session would grow
+ * without bound. Past TRACE_MAX_EVENTS (about 12 MiB) new events are
+ * dropped and counted instead: the start of the session, which is what
+ * a trace is usually taken for, stays complete.
+ */
+#define TRACE_MAX_EVENTS  (256 * 1024)
+
+typedef struct
+{
+  const gchar *name;
+  gchar        phase;
+  gint64       ts;
+  gint64       dur;
+  gint         tid;
+  guint        id;
+  guint        depth;
+} TraceEvent;
+
+typedef struct
+{
+  gint   tid;
+  guint  depth;
+} TraceThread;
+
+static volatile gint trace_enabled = FALSE;
+static gchar *trace_path = NULL;
+static GMutex events_mutex;
+static GArray *events = NULL;
+static guint n_dropped = 0;
+static volatile gint last_flow_id = 0;
+
+static GPrivate trace_thread = G_PRIVATE_INIT (g_free);
+
+
+static TraceThread *
+get_trace_thread (void)
+{
+  TraceThread *thread;
+
+  thread = g_private_get (&trace_thread);
+  if (G_UNLIKELY (thread == NULL)) {
+    thread = g_new0 (TraceThread, 1);
+    thread->tid = (gint) syscall (SYS_gettid);
+    g_private_set (&trace_thread, thread);
+  }
+
+  return thread;
+}
+
+static void
+push_event (const TraceEvent *event)
+{
+  g_mutex_lock (&events_mutex);
+  if (events != NULL) {
+    if (events->len < TRACE_MAX_EVENTS)
+      g_array_append_vals (events, event, 1);
+    else
+      n_dropped++;
+  }
+  g_mutex_unlock (&events_mutex);
+}
+
+void
+deap_trace_init (const gchar *path)
+{
+  if (path == NULL || *path == '\0' || trace_enabled)
+    return;
+
+  trace_path = g_strdup (path);
+  n_dropped = 0;
+  events = g_array_sized_new (FALSE, FALSE, sizeof (TraceEvent), 4096);
+
+  g_atomic_int_set (&trace_enabled, TRUE);
+}
+
+gboolean
+deap_trace_is_enabled (void)
+{
+  return g_atomic_int_get (&trace_enabled);
+}
+
+DeapTraceSpan
+deap_trace_span_begin (const gchar *name)
+{
+  DeapTraceSpan span = { name, 0 };
+
+  if (!deap_trace_is_enabled ())
+    return span;
+
+  get_trace_thread ()->depth++;
+  span.begin = g_get_monotonic_time ();
+
+  return span;
+}
+
+void
+deap_trace_span_end (DeapTraceSpan *span)
+{
+  TraceThread *thread;
+  TraceEvent event = { 0 };
+
+  if (span->begin == 0 || !deap_trace_is_enabled ())
+    return;
+
+  thread = get_trace_thread ();
+  thread->depth--;
+
+  event.name = span->name;
+  event.phase = 'X';
+  event.ts = span->begin;
+  event.dur = g_get_monotonic_time () - span->begin;
+  event.tid = thread->tid;
+  event.depth = thread->depth;
+
+  push_event (&event);
+}
+
+guint
+deap_trace_flow_begin (const gchar *name)
+{
+  TraceEvent event = { 0 };
+
+  if (!deap_trace_is_enabled ())
+    return 0;
+
+  event.name = name;
+  event.phase = 'b';
+  event.ts = g_get_monotonic_time ();
+  event.tid = get_trace_thread ()->tid;
+  event.id = (guint) g_atomic_int_add (&last_flow_id, 1) + 1;
+
+  push_event (&event);
+
+  return event.id;
+}
+
+void
+deap_trace_flow_end (guint        flow_id,
+                     const gchar *name)
+{
+  TraceEvent event = { 0 };
+
+  if (flow_id == 0 || !deap_trace_is_enabled ())
+    return;
+
+  event.name = name;
+  event.phase = 'e';
+  event.ts = g_get_monotonic_time ();
+  event.tid = get_trace_thread ()->tid;
+  event.id = flow_id;
+
+  push_event (&event);
+}
+
+static void
+write_event (FILE             *file,
+             const TraceEvent *event,
+             gint              pid,
+             gboolean          first)
+{
+  g_autoptr(GString) name = g_string_new (NULL);
+
+  deap_json_append_string (name, event->name);
+
+  fprintf (file, "%s\n  {\"name\": %s, \"ph\": \"%c\", \"pid\": %d, \"tid\": %d, "
+                 "\"ts\": %" G_GINT64_FORMAT,
+           first ? "" : ",", name->str, event->phase, pid, event->tid, event->ts);
+
+  switch (event->phase) {
+    case 'X':
+      fprintf (file, ", \"cat\": \"span\", \"dur\": %" G_GINT64_FORMAT ", \"args\": {\"depth\": %u}}",
+               event->dur, event->depth);
+      break;
+
+    case 'b':
+    case 'e':
+      /* The async slice, plus a flow arrow from the issuing to the finishing span */
+      fprintf (file, ", \"cat\": \"dbus\", \"id\": \"0x%x\"},", event->id);
+      fprintf (file, "\n  {\"name\": %s, \"ph\": \"%s\", \"pid\": %d, \"tid\": %d, "
+                     "\"ts\": %" G_GINT64_FORMAT ", \"cat\": \"dbus\", \"id\": \"0x%x\"%s}",
+               name->str, event->phase == 'b' ? "s" : "f", pid, event->tid, event->ts,
+               event->id, event->phase == 'e' ? ", \"bp\": \"e\"" : "");
+      break;
+
+    default:
+      fprintf (file, "}");
+  }
+}
+
+void
+deap_trace_shutdown (void)
+{
+  FILE *file;
+  guint dropped;
+  guint i;
+  gint pid;
+
+  if (!deap_trace_is_enabled ())
+    return;
+
+  g_atomic_int_set (&trace_enabled, FALSE);
+
+  file = fopen (trace_path, "w");
+  if (file == NULL) {
+    deap_warn_msg ("Could not write trace to %s", trace_path);
+    goto out;
+  }
+
+  pid = getpid ();
+
+  fprintf (file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+  g_mutex_lock (&events_mutex);
+  for (i = 0; i < events->len; i++)
+    write_event (file, &g_array_index (events, TraceEvent, i), pid, i == 0);
+  dropped = n_dropped;
+  g_mutex_unlock (&events_mutex);
+
+  fprintf (file, "\n], \"otherData\": {\"dropped_events\": \"%u\"}}\n", dropped);
+  fclose (file);
+
+  if (dropped > 0)
+    deap_warn_msg ("%u trace events dropped, the trace was full", dropped);
+
+  deap_info_msg ("Trace written to %s", trace_path);
+
+out:
+  g_mutex_lock (&events_mutex);
+  g_clear_pointer (&events, g_array_unref);
+  g_mutex_unlock (&events_mutex);
+
+  g_clear_pointer (&trace_path, g_free);
+}
@@ -0,0 +1,57 @@
+/* deap-trace.h
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Trace spans
+ *
+ * When tracing is enabled (DEAP_TRACE_FILE or --trace-file), spans and
+ * async flows are collected with monotonic timestamps and thread IDs and
+ * written out as Chrome trace-event JSON on exit, ready to be loaded in
+ * Perfetto or chrome://tracing. Names must be static strings.
+ */
+typedef struct
+{
+  const gchar *name;
+  gint64       begin;
+} DeapTraceSpan;
+
+void            deap_trace_init             (const gchar   *path);
+void            deap_trace_shutdown         (void);
+gboolean        deap_trace_is_enabled       (void);
+
+DeapTraceSpan   deap_trace_span_begin       (const gchar   *name);
+void            deap_trace_span_end         (DeapTraceSpan *span);
+
+guint           deap_trace_flow_begin       (const gchar   *name);
+void            deap_trace_flow_end         (guint          flow_id,
+                                             const gchar   *name);
+
+/* The span ends when the enclosing block is left, early returns included */
+#define DEAP_TRACE_SCOPE(name) \
+  DeapTraceSpan G_PASTE (_deap_trace_span_, __LINE__) \
+    __attribute__((cleanup (deap_trace_span_end))) = deap_trace_span_begin (name)
+
+G_END_DECLS
@@ -17,20 +17,73 @@
  */
 
 #include "deap-debug.h"
+#include "deap-metrics.h"
 #include "gtd-log.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include <glib.h>
 
-G_LOCK_DEFINE_STATIC (channel_lock);
+/*
+ * Log lines are formatted straight into the slots of a bounded ring and
+ * written to stdout by a dedicated writer thread, so a slow stdout (a
+ * pager, the journal) never stalls the thread which logs.
+ *
+ * The ring is a bounded multi-producer queue: each slot carries a
+ * sequence number telling whether it is free for the producer at that
+ * position or ready for the consumer. Claiming a slot is a single CAS,
+ * publishing it is a single store.
+ *
+ * When the ring is full, the DEAP_LOG_OVERFLOW environment variable
+ * decides what happens:
+ *   "drop"  (default) the message is discarded and counted; the writer
+ *           reports the count as soon as there is room again.
+ *   "block" the logging thread waits until the writer frees a slot.
+ * Fatal messages always block and are flushed before returning.
+ */
+
+#define GTD_LOG_RING_SIZE        1024   /* Must be a power of two */
+#define GTD_LOG_RING_MASK        (GTD_LOG_RING_SIZE - 1)
+#define GTD_LOG_LINE_MAX         1024
+#define GTD_LOG_WRITEV_BATCH     MIN (IOV_MAX, 64)
+#define GTD_LOG_FLUSH_TIMEOUT    (G_USEC_PER_SEC)
+
+typedef enum
+{
+  GTD_LOG_OVERFLOW_DROP,
+  GTD_LOG_OVERFLOW_BLOCK,
+} GtdLogOverflowPolicy;
 
-GIOChannel *standard_channel = NULL;
+typedef struct
+{
+  volatile gint  sequence;
+  gsize          len;
+  gchar          line[GTD_LOG_LINE_MAX];
+} GtdLogSlot;
 
-static const gchar* ignored_domains[] =
+typedef struct
 {
-  "GdkPixbuf",
-  NULL
-};
+  gint64  second;
+  gchar   ftime[16];
+} GtdLogThreadState;
+
+static GtdLogSlot *ring = NULL;
+static volatile gint enqueue_pos = 0;
+static volatile gint written_pos = 0;
+static volatile gint dropped = 0;
+static volatile gint writer_sleeping = 0;
+
+static GtdLogOverflowPolicy overflow_policy = GTD_LOG_OVERFLOW_DROP;
+
+static GMutex writer_mutex;
+static GCond writer_cond;
+
+static GPrivate thread_state = G_PRIVATE_INIT (g_free);
 
 static const gchar *
 log_level_str (GLogLevelFlags log_level)
@@ -50,44 +103,262 @@ log_level_str (GLogLevelFlags log_level)
     }
 }
 
+/* Formatting the wall clock is only needed once per second and thread */
+static const gchar *
+get_cached_ftime (gint64 now)
+{
+  GtdLogThreadState *state;
+  gint64 second;
+
+  state = g_private_get (&thread_state);
+  if (G_UNLIKELY (state == NULL)) {
+    state = g_new0 (GtdLogThreadState, 1);
+    state->second = -1;
+    g_private_set (&thread_state, state);
+  }
+
+  second = now / G_USEC_PER_SEC;
+  if (state->second != second) {
+    struct tm tt;
+    time_t t = (time_t) second;
+
+    localtime_r (&t, &tt);
+    strftime (state->ftime, sizeof (state->ftime), "%H:%M:%S", &tt);
+    state->second = second;
+  }
+
+  return state->ftime;
+}
+
+static void
+wake_up_writer (void)
+{
+  if (g_atomic_int_get (&writer_sleeping)) {
+    g_mutex_lock (&writer_mutex);
+    g_cond_signal (&writer_cond);
+    g_mutex_unlock (&writer_mutex);
+  }
+}
+
+static GtdLogSlot *
+claim_slot (gboolean  block,
+            guint    *out_pos)
+{
+  guint pos;
+
+  pos = (guint) g_atomic_int_get (&enqueue_pos);
+
+  for (;;) {
+    GtdLogSlot *slot = &ring[pos & GTD_LOG_RING_MASK];
+    gint diff = (gint) ((guint) g_atomic_int_get (&slot->sequence) - pos);
+
+    if (diff == 0) {
+      if (g_atomic_int_compare_and_exchange (&enqueue_pos, (gint) pos, (gint) (pos + 1))) {
+        *out_pos = pos;
+        return slot;
+      }
+    } else if (diff < 0) {
+      /* The ring is full */
+      if (!block)
+        return NULL;
+
+      wake_up_writer ();
+      g_thread_yield ();
+    }
+
+    pos = (guint) g_atomic_int_get (&enqueue_pos);
+  }
+}
+
+static void
+publish_slot (GtdLogSlot *slot,
+              guint       pos)
+{
+  g_atomic_int_set (&slot->sequence, (gint) (pos + 1));
+  wake_up_writer ();
+}
+
+static void
+write_all (struct iovec *iov,
+           gint          iovcnt)
+{
+  while (iovcnt > 0) {
+    gssize written = writev (STDOUT_FILENO, iov, iovcnt);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN) {
+        g_usleep (1000);
+        continue;
+      }
+      return;
+    }
+
+    while (iovcnt > 0 && (gsize) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if (iovcnt > 0) {
+      iov->iov_base = (gchar *) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
+static void
+report_dropped (void)
+{
+  gchar buffer[128];
+  struct iovec iov;
+  gint n_dropped;
+
+  n_dropped = g_atomic_int_and ((guint *) &dropped, 0);
+  if (n_dropped == 0)
+    return;
+
+  deap_metrics_counter_add ("log.dropped", n_dropped);
+
+  iov.iov_base = buffer;
+  iov.iov_len = g_snprintf (buffer, sizeof (buffer),
+                            "%d log messages dropped, the log ring was full\n",
+                            n_dropped);
+  write_all (&iov, 1);
+}
+
+static gpointer
+writer_thread_func (gpointer user_data)
+{
+  struct iovec iov[GTD_LOG_WRITEV_BATCH];
+  guint pos = 0;
+
+  for (;;) {
+    gint n_ready = 0;
+    gint i;
+
+    /* Collect every published slot, up to a batch */
+    while (n_ready < GTD_LOG_WRITEV_BATCH) {
+      GtdLogSlot *slot = &ring[(pos + n_ready) & GTD_LOG_RING_MASK];
+
+      if ((guint) g_atomic_int_get (&slot->sequence) != pos + n_ready + 1)
+        break;
+
+      iov[n_ready].iov_base = slot->line;
+      iov[n_ready].iov_len = slot->len;
+      n_ready++;
+    }
+
+    if (n_ready == 0) {
+      g_mutex_lock (&writer_mutex);
+      g_atomic_int_set (&writer_sleeping, 1);
+
+      /* Re-check under the lock so a wake up cannot be missed */
+      if ((guint) g_atomic_int_get (&ring[pos & GTD_LOG_RING_MASK].sequence) != pos + 1)
+        g_cond_wait_until (&writer_cond, &writer_mutex,
+                           g_get_monotonic_time () + G_USEC_PER_SEC / 10);
+
+      g_atomic_int_set (&writer_sleeping, 0);
+      g_mutex_unlock (&writer_mutex);
+      continue;
+    }
+
+    write_all (iov, n_ready);
+
+    /* Hand the slots back to the producers */
+    for (i = 0; i < n_ready; i++, pos++)
+      g_atomic_int_set (&ring[pos & GTD_LOG_RING_MASK].sequence,
+                        (gint) (pos + GTD_LOG_RING_SIZE));
+
+    g_atomic_int_set (&written_pos, (gint) pos);
+
+    report_dropped ();
+  }
+
+  return NULL;
+}
+
+void
+gtd_log_flush (void)
+{
+  gint64 deadline;
+  guint target;
+
+  if (ring == NULL)
+    return;
+
+  target = (guint) g_atomic_int_get (&enqueue_pos);
+  deadline = g_get_monotonic_time () + GTD_LOG_FLUSH_TIMEOUT;
+
+  while ((gint) ((guint) g_atomic_int_get (&written_pos) - target) < 0) {
+    if (g_get_monotonic_time () > deadline)
+      break;
+
+    wake_up_writer ();
+    g_usleep (100);
+  }
+}
+
+gsize
+gtd_log_format_line (gchar          *buffer,
+                     gsize           size,
+                     gint64          real_time,
+                     const gchar    *domain,
+                     GLogLevelFlags  log_level,
+                     const gchar    *message)
+{
+  gint len;
+
+  len = g_snprintf (buffer, size,
+                    "%s.%04d  %24s: %s: %s\n",
+                    get_cached_ftime (real_time),
+                    (gint) ((real_time % G_USEC_PER_SEC) / 1000),
+                    domain,
+                    log_level_str (log_level),
+                    message);
+
+  /* Truncated, still terminate the line */
+  if (len >= (gint) size) {
+    len = size - 1;
+    buffer[len - 1] = '\n';
+  }
+
+  return len;
+}
+
 static void
 gtd_log_handler (const gchar    *domain,
                   GLogLevelFlags  log_level,
                   const gchar    *message,
                   gpointer        user_data)
 {
-  GTimeVal tv;
-  struct tm tt;
-  time_t t;
-  const gchar *level;
-  gchar ftime[32];
-  gchar *buffer;
-
-  /* Skip ignored log domains */
-  if (domain && g_strv_contains (ignored_domains, domain))
-    return;
+  GtdLogSlot *slot;
+  gboolean fatal;
+  guint pos;
 
-  level = log_level_str (log_level);
-  g_get_current_time (&tv);
-  t = (time_t) tv.tv_sec;
-  tt = *localtime (&t);
-  strftime (ftime, sizeof (ftime), "%H:%M:%S", &tt);
-  buffer = g_strdup_printf ("%s.%04ld  %24s: %s: %s\n",
-                            ftime,
-                            tv.tv_usec / 1000,
-                            domain,
-                            level,
-                            message);
+  fatal = (log_level & (G_LOG_FLAG_FATAL | G_LOG_LEVEL_ERROR)) != 0;
 
-  /* Safely write to the channel */
-  G_LOCK (channel_lock);
+  /* Skip disabled log domains and levels, see deap-debug.c */
+  if (!fatal && !deap_log_domain_is_enabled (domain, log_level & G_LOG_LEVEL_MASK))
+    return;
 
-  g_io_channel_write_chars (standard_channel, buffer, -1, NULL, NULL);
-  g_io_channel_flush (standard_channel, NULL);
+  slot = claim_slot (fatal || overflow_policy == GTD_LOG_OVERFLOW_BLOCK, &pos);
+  if (slot == NULL) {
+    g_atomic_int_inc (&dropped);
+    return;
+  }
 
-  G_UNLOCK (channel_lock);
+  slot->len = gtd_log_format_line (slot->line,
+                                   sizeof (slot->line),
+                                   g_get_real_time (),
+                                   domain,
+                                   log_level,
+                                   message);
+  publish_slot (slot, pos);
 
-  g_free (buffer);
+  if (fatal)
+    gtd_log_flush ();
 }
 
 void
@@ -97,11 +368,23 @@ gtd_log_init (void)
 
   if (g_once_init_enter (&initialized))
     {
-      standard_channel = g_io_channel_unix_new (STDOUT_FILENO);
+      const gchar *policy;
+      guint i;
+
+      policy = g_getenv ("DEAP_LOG_OVERFLOW");
+      if (g_strcmp0 (policy, "block") == 0)
+        overflow_policy = GTD_LOG_OVERFLOW_BLOCK;
+
+      ring = g_new0 (GtdLogSlot, GTD_LOG_RING_SIZE);
+      for (i = 0; i < GTD_LOG_RING_SIZE; i++)
+        ring[i].sequence = i;
+
+      g_thread_unref (g_thread_new ("gtd-log-writer", writer_thread_func, NULL));
+
+      atexit (gtd_log_flush);
 
       g_log_set_default_handler (gtd_log_handler, NULL);
 
       g_once_init_leave (&initialized, TRUE);
     }
 }
-
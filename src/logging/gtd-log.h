@@ -24,4 +24,13 @@ G_BEGIN_DECLS
 
 void                 gtd_log_init                               (void);
 
+void                 gtd_log_flush                              (void);
+
+gsize                gtd_log_format_line                        (gchar          *buffer,
+                                                                 gsize           size,
+                                                                 gint64          real_time,
+                                                                 const gchar    *domain,
+                                                                 GLogLevelFlags  log_level,
+                                                                 const gchar    *message);
+
 G_END_DECLS
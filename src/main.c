@@ -20,6 +20,9 @@
 
 #include "deap-config.h"
 #include "deap-application.h"
+#include "deap-metrics.h"
+#include "deap-profile.h"
+#include "deap-trace.h"
 
 int
 main (int   argc,
@@ -28,6 +31,12 @@ main (int   argc,
 	g_autoptr(DeapApplication) app = NULL;
 	int ret;
 
+	deap_metrics_init ();
+	deap_profile_init ();
+	deap_profile_mark ("main");
+
+	deap_trace_init (g_getenv ("DEAP_TRACE_FILE"));
+
 	/* Set up gettext translations */
 	bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
@@ -0,0 +1,97 @@
+/* deap-alloc-count.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Heap allocation counting for tests and benchmarks, by interposing
+ * malloc, calloc and realloc, which needs glibc; elsewhere nothing is
+ * counted and deap_alloc_count_is_supported() says so.
+ *
+ * Run with G_SLICE=always-malloc: older GLib serves g_slice from
+ * magazines which malloc would not see, and reads the variable before
+ * main().
+ */
+
+#include "deap-alloc-count.h"
+
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+# define HAVE_ALLOCATION_COUNT 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static volatile gint counting = 0;
+static volatile guint64 n_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb,
+        size_t size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  if (counting)
+    n_allocations++;
+  return __libc_realloc (ptr, size);
+}
+#else
+# define HAVE_ALLOCATION_COUNT 0
+
+static gint counting = 0;
+static guint64 n_allocations = 0;
+#endif
+
+gboolean
+deap_alloc_count_is_supported (void)
+{
+  return HAVE_ALLOCATION_COUNT;
+}
+
+void
+deap_alloc_count_begin (void)
+{
+  n_allocations = 0;
+  counting = 1;
+}
+
+/* Returns: the allocations since deap_alloc_count_begin() */
+guint64
+deap_alloc_count_end (void)
+{
+  counting = 0;
+
+  return n_allocations;
+}
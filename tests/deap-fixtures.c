@@ -0,0 +1,76 @@
+/* deap-fixtures.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Synthetic D-Bus replies shared by the tests and the benchmarks, so
+ * both measure the same input.
+ */
+
+#include "deap-fixtures.h"
+#include "deap-shell-extension.h"
+
+/* Serialized, as g_dbus_message_get_body() would hand it over */
+static GVariant *
+serialize (GVariant *value)
+{
+  g_autoptr(GVariant) sunk = g_variant_ref_sink (value);
+  g_autoptr(GBytes) bytes = g_variant_get_data_as_bytes (sunk);
+
+  return g_variant_ref_sink (g_variant_new_from_bytes (g_variant_get_type (sunk), bytes, FALSE));
+}
+
+/*
+ * deap_fixtures_new_extension_list
+ *
+ * A ListExtensions reply: extension i has the UUID
+ * "extension-<i>@deap.example.org", the name "Extension <i>", six
+ * fields in all, and is enabled when i is even, disabled otherwise.
+ *
+ * Returns: (transfer full): a serialized a{sa{sv}}
+ */
+GVariant *
+deap_fixtures_new_extension_list (guint n_extensions)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+  for (i = 0; i < n_extensions; i++) {
+    g_autofree gchar *uuid = g_strdup_printf ("extension-%u@deap.example.org", i);
+    g_autofree gchar *name = g_strdup_printf ("Extension %u", i);
+    g_autofree gchar *url = g_strdup_printf ("https://extensions.example.org/%u", i);
+    GVariantDict dict;
+
+    g_variant_dict_init (&dict, NULL);
+    g_variant_dict_insert (&dict, "uuid", "s", uuid);
+    g_variant_dict_insert (&dict, "name", "s", name);
+    g_variant_dict_insert (&dict, "description", "s", "Synthetic ListExtensions entry");
+    g_variant_dict_insert (&dict, "url", "s", url);
+    g_variant_dict_insert (&dict, "type", "d", 2.0);
+    g_variant_dict_insert (&dict, "state", "d",
+                           (gdouble) (i % 2 == 0 ? DEAP_SHELL_EXTENSION_STATE_ENABLED
+                                                 : DEAP_SHELL_EXTENSION_STATE_DISABLED));
+
+    g_variant_builder_add (&builder, "{s@a{sv}}", uuid, g_variant_dict_end (&dict));
+  }
+
+  return serialize (g_variant_builder_end (&builder));
+}
@@ -0,0 +1,284 @@
+/* test-login1-session.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "deap-config.h"
+#include "deap-login1-session.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+typedef struct
+{
+  gchar        *root;
+  gchar        *dir;
+
+  GArray       *sessions;
+  GStringChunk *strings;
+  GHashTable   *session_index;
+} Fixture;
+
+static void
+write_state_file (Fixture     *fixture,
+                  const gchar *name,
+                  const gchar *contents)
+{
+  g_autofree gchar *path = g_build_filename (fixture->dir, name, NULL);
+  g_autoptr(GError) error = NULL;
+
+  g_file_set_contents (path, contents, -1, &error);
+  g_assert_no_error (error);
+}
+
+/* A fake /run/systemd/sessions, as logind leaves it, below DEAP_SYSTEMD_ROOT */
+static void
+fixture_set_up (Fixture       *fixture,
+                gconstpointer  user_data)
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *expected = NULL;
+
+  fixture->root = g_dir_make_tmp ("deap-systemd-XXXXXX", &error);
+  g_assert_no_error (error);
+
+  g_setenv ("DEAP_SYSTEMD_ROOT", fixture->root, TRUE);
+  fixture->dir = deap_login1_session_get_state_dir ();
+
+  expected = g_build_filename (fixture->root, "run", "systemd", "sessions", NULL);
+  g_assert_cmpstr (fixture->dir, ==, expected);
+  g_assert_cmpint (g_mkdir_with_parents (fixture->dir, 0700), ==, 0);
+
+  write_state_file (fixture, "2",
+                    "# This is private data. Do not parse.\n"
+                    "UID=1000\n"
+                    "USER=alice\n"
+                    "ACTIVE=1\n"
+                    "STATE=active\n"
+                    "SEAT=seat0\n");
+  write_state_file (fixture, "5",
+                    "UID=1001\n"
+                    "USER=bob\n"
+                    "SEAT=seat0");
+  write_state_file (fixture, "c1",
+                    "UID=42\n"
+                    "USER=gdm\n");
+  write_state_file (fixture, "7",
+                    "STATE=opening\n");
+
+  /* The FIFO and a temporary logind renames into place */
+  write_state_file (fixture, "2.ref", "");
+  write_state_file (fixture, ".#8Xa1b2c", "UID=1002\nUSER=carol\n");
+
+  fixture->sessions = g_array_new (FALSE, TRUE, sizeof (DeapLogin1Session));
+  fixture->strings = g_string_chunk_new (1024);
+  fixture->session_index = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+    g_autofree gchar *child = g_build_filename (path, name, NULL);
+
+    if (g_file_test (child, G_FILE_TEST_IS_DIR))
+      remove_tree (child);
+    else
+      g_unlink (child);
+  }
+
+  g_rmdir (path);
+}
+
+static void
+fixture_tear_down (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  g_hash_table_unref (fixture->session_index);
+  g_array_unref (fixture->sessions);
+  g_string_chunk_free (fixture->strings);
+
+  remove_tree (fixture->root);
+  g_unsetenv ("DEAP_SYSTEMD_ROOT");
+
+  g_free (fixture->dir);
+  g_free (fixture->root);
+}
+
+static const DeapLogin1Session *
+lookup (Fixture     *fixture,
+        const gchar *session_id)
+{
+  guint position = GPOINTER_TO_UINT (g_hash_table_lookup (fixture->session_index, session_id));
+
+  g_assert_cmpuint (position, >, 0);
+
+  return &g_array_index (fixture->sessions, DeapLogin1Session, position - 1);
+}
+
+static void
+test_read_dir (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  g_autoptr(GError) error = NULL;
+  const DeapLogin1Session *session;
+  guint n;
+
+  n = deap_login1_session_read_dir (fixture->dir,
+                                    fixture->sessions,
+                                    fixture->strings,
+                                    fixture->session_index,
+                                    &error);
+  g_assert_no_error (error);
+
+  /* Neither 2.ref nor .#8Xa1b2c */
+  g_assert_cmpuint (n, ==, 4);
+  g_assert_false (g_hash_table_contains (fixture->session_index, "2.ref"));
+  g_assert_false (g_hash_table_contains (fixture->session_index, ".#8Xa1b2c"));
+
+  session = lookup (fixture, "2");
+  g_assert_cmpuint (session->user_id, ==, 1000);
+  g_assert_cmpstr (session->user_name, ==, "alice");
+  g_assert_cmpstr (session->seat_id, ==, "seat0");
+
+  /* No trailing newline */
+  session = lookup (fixture, "5");
+  g_assert_cmpstr (session->user_name, ==, "bob");
+  g_assert_cmpstr (session->seat_id, ==, "seat0");
+
+  /* Interned, so every session shares one "seat0" */
+  g_assert_true (session->seat_id == lookup (fixture, "2")->seat_id);
+
+  /* Seatless, like ListSessions reports it */
+  session = lookup (fixture, "c1");
+  g_assert_cmpuint (session->user_id, ==, 42);
+  g_assert_cmpstr (session->seat_id, ==, "");
+
+  /* Without UID and USER, left for the bus to fill in */
+  session = lookup (fixture, "7");
+  g_assert_null (session->user_name);
+}
+
+static void
+test_read_dir_missing (void)
+{
+  g_autoptr(GArray) sessions = g_array_new (FALSE, TRUE, sizeof (DeapLogin1Session));
+  g_autoptr(GHashTable) session_index = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GError) error = NULL;
+  GStringChunk *strings = g_string_chunk_new (1024);
+
+  g_assert_cmpuint (deap_login1_session_read_dir ("/nonexistent/run/systemd/sessions",
+                                                  sessions, strings, session_index, &error), ==, 0);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+
+  g_string_chunk_free (strings);
+}
+
+static void
+test_parse_state (void)
+{
+  GStringChunk *strings = g_string_chunk_new (1024);
+  DeapLogin1Session session;
+  const gchar *contents;
+
+  contents = "UID=1000\nUSER=alice\n";
+  g_assert_true (deap_login1_session_parse_state ("3", contents, strlen (contents), strings, &session));
+  g_assert_cmpstr (session.session_id, ==, "3");
+  g_assert_cmpuint (session.user_id, ==, 1000);
+  g_assert_cmpstr (session.user_name, ==, "alice");
+
+  contents = "USER=alice\n";
+  g_assert_false (deap_login1_session_parse_state ("3", contents, strlen (contents), strings, &session));
+
+  contents = "UID=1000\n";
+  g_assert_false (deap_login1_session_parse_state ("3", contents, strlen (contents), strings, &session));
+  g_assert_null (session.user_name);
+
+  contents = "UID=nobody\nUSER=alice\n";
+  g_assert_false (deap_login1_session_parse_state ("3", contents, strlen (contents), strings, &session));
+
+  g_assert_false (deap_login1_session_parse_state ("3", "", 0, strings, &session));
+
+  g_string_chunk_free (strings);
+}
+
+static void
+test_is_state_file (void)
+{
+  g_assert_true (deap_login1_session_is_state_file ("2"));
+  g_assert_true (deap_login1_session_is_state_file ("c1"));
+
+  g_assert_false (deap_login1_session_is_state_file (""));
+  g_assert_false (deap_login1_session_is_state_file ("2.ref"));
+  g_assert_false (deap_login1_session_is_state_file (".#2Xa1b2c"));
+}
+
+static void
+test_id_is_valid (void)
+{
+  g_assert_true (deap_login1_session_id_is_valid ("2"));
+  g_assert_true (deap_login1_session_id_is_valid ("c1"));
+
+  g_assert_false (deap_login1_session_id_is_valid (""));
+  g_assert_false (deap_login1_session_id_is_valid ("a-b"));
+  g_assert_false (deap_login1_session_id_is_valid ("../2"));
+  g_assert_false (deap_login1_session_id_is_valid ("2 3"));
+}
+
+static void
+test_object_path (void)
+{
+  static const struct {
+    const gchar *session_id;
+    const gchar *object_path;
+  } cases[] = {
+    { "c1", "/org/freedesktop/login1/session/c1" },
+    { "2", "/org/freedesktop/login1/session/_32" },
+    { "12", "/org/freedesktop/login1/session/_312" },
+    { "a-b", "/org/freedesktop/login1/session/a_2db" },
+    { "", "/org/freedesktop/login1/session/_" },
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+    g_autofree gchar *object_path = deap_login1_session_object_path (cases[i].session_id);
+
+    g_assert_cmpstr (object_path, ==, cases[i].object_path);
+    g_assert_true (g_variant_is_object_path (object_path));
+  }
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/login1-session/read-dir", Fixture, NULL,
+              fixture_set_up, test_read_dir, fixture_tear_down);
+  g_test_add_func ("/login1-session/read-dir-missing", test_read_dir_missing);
+  g_test_add_func ("/login1-session/parse-state", test_parse_state);
+  g_test_add_func ("/login1-session/is-state-file", test_is_state_file);
+  g_test_add_func ("/login1-session/id-is-valid", test_id_is_valid);
+  g_test_add_func ("/login1-session/object-path", test_object_path);
+
+  return g_test_run ();
+}
@@ -0,0 +1,168 @@
+/* test-palette-index.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "deap-config.h"
+#include "deap-palette-index.h"
+
+/* Above the rebuild threshold of 64 dead keys, and 4 times that */
+#define N_KEYS  256
+
+static guint n_destroyed;
+
+static void
+count_destroy (gpointer data)
+{
+  n_destroyed++;
+}
+
+static DeapPaletteIndex *
+new_index (void)
+{
+  DeapPaletteIndex *index;
+  guint i;
+
+  n_destroyed = 0;
+  index = deap_palette_index_new (count_destroy);
+
+  deap_palette_index_begin_bulk_insert (index);
+  for (i = 0; i < N_KEYS; i++) {
+    g_autofree gchar *key = g_strdup_printf ("entry %03u", i);
+
+    g_assert_true (deap_palette_index_insert (index, key, GUINT_TO_POINTER (i + 1)));
+  }
+  deap_palette_index_end_bulk_insert (index);
+
+  return index;
+}
+
+static void
+test_insert (void)
+{
+  g_autoptr(DeapPaletteIndex) index = new_index ();
+  g_autoptr(GPtrArray) matches = NULL;
+
+  g_assert_cmpuint (deap_palette_index_get_n_live (index), ==, N_KEYS);
+  g_assert_true (deap_palette_index_lookup (index, "entry 007") == GUINT_TO_POINTER (8));
+  g_assert_null (deap_palette_index_lookup (index, "entry"));
+
+  /* A taken key leaves the value alone */
+  g_assert_false (deap_palette_index_insert (index, "entry 007", GUINT_TO_POINTER (1)));
+  g_assert_true (deap_palette_index_lookup (index, "entry 007") == GUINT_TO_POINTER (8));
+  g_assert_cmpuint (n_destroyed, ==, 0);
+
+  matches = deap_palette_index_match (index, "ENTRY 007", 10);
+  g_assert_cmpuint (matches->len, >=, 1);
+  g_assert_true (g_ptr_array_index (matches, 0) == GUINT_TO_POINTER (8));
+}
+
+static void
+test_remove (void)
+{
+  g_autoptr(DeapPaletteIndex) index = new_index ();
+  guint i;
+
+  g_assert_false (deap_palette_index_remove (index, "entry"));
+
+  for (i = 0; i < N_KEYS; i += 2) {
+    g_autofree gchar *key = g_strdup_printf ("entry %03u", i);
+
+    g_assert_true (deap_palette_index_remove (index, key));
+    g_assert_null (deap_palette_index_lookup (index, key));
+  }
+
+  g_assert_cmpuint (deap_palette_index_get_n_live (index), ==, N_KEYS / 2);
+
+  /* Dead keys never match, whatever is left to rebuild */
+  for (i = 0; i < 10; i++) {
+    g_autoptr(GPtrArray) matches = deap_palette_index_match (index, "entry 0", 10);
+    guint j;
+
+    g_assert_cmpuint (matches->len, ==, 10);
+    for (j = 0; j < matches->len; j++)
+      g_assert_cmpuint (GPOINTER_TO_UINT (g_ptr_array_index (matches, j)) % 2, ==, 0);
+  }
+
+  /* Same key, new value: the dead one must not shadow it */
+  g_assert_true (deap_palette_index_insert (index, "entry 000", GUINT_TO_POINTER (N_KEYS + 1)));
+  g_assert_true (deap_palette_index_lookup (index, "entry 000") == GUINT_TO_POINTER (N_KEYS + 1));
+}
+
+static void
+test_rebuild (void)
+{
+  g_autoptr(DeapPaletteIndex) index = new_index ();
+  guint i;
+
+  for (i = 0; i < 64; i++) {
+    g_autofree gchar *key = g_strdup_printf ("entry %03u", i);
+
+    deap_palette_index_remove (index, key);
+  }
+
+  /* Values outlive their removal until the index is rebuilt */
+  g_assert_cmpuint (deap_palette_index_get_n_dead (index), ==, 64);
+  g_assert_cmpuint (n_destroyed, ==, 0);
+
+  deap_palette_index_remove (index, "entry 064");
+
+  g_assert_cmpuint (deap_palette_index_get_n_dead (index), ==, 0);
+  g_assert_cmpuint (n_destroyed, ==, 65);
+  g_assert_cmpuint (deap_palette_index_get_n_live (index), ==, N_KEYS - 65);
+
+  g_clear_pointer (&index, deap_palette_index_free);
+  g_assert_cmpuint (n_destroyed, ==, N_KEYS);
+}
+
+/* Removals pile up during a bulk insertion and are dropped at its end */
+static void
+test_bulk_insert (void)
+{
+  g_autoptr(DeapPaletteIndex) index = new_index ();
+  guint i;
+
+  deap_palette_index_begin_bulk_insert (index);
+
+  for (i = 0; i < 128; i++) {
+    g_autofree gchar *key = g_strdup_printf ("entry %03u", i);
+
+    deap_palette_index_remove (index, key);
+  }
+
+  g_assert_cmpuint (deap_palette_index_get_n_dead (index), ==, 128);
+
+  deap_palette_index_end_bulk_insert (index);
+
+  g_assert_cmpuint (deap_palette_index_get_n_dead (index), ==, 0);
+  g_assert_cmpuint (n_destroyed, ==, 128);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/palette-index/insert", test_insert);
+  g_test_add_func ("/palette-index/remove", test_remove);
+  g_test_add_func ("/palette-index/rebuild", test_rebuild);
+  g_test_add_func ("/palette-index/bulk-insert", test_bulk_insert);
+
+  return g_test_run ();
+}
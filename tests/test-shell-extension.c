@@ -0,0 +1,97 @@
+/* test-shell-extension.c
+ *
+ * Copyright 2019 Yi-Soo An <yisooan@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "deap-config.h"
+#include "deap-alloc-count.h"
+#include "deap-fixtures.h"
+#include "deap-shell-extension.h"
+
+#define N_EXTENSIONS  1000
+
+/*
+ * The strings are borrowed from the reply, so parsing allocates no
+ * copies. What it does allocate, per extension: the {sa{sv}} entry, its
+ * a{sv} and the DeapShellExtension, and for each of the six fields four
+ * transient GVariant wrappers (the {sv} entry, its key, its v and the
+ * value inside), freed again right away.
+ *
+ * That is 27, measured with GLib 2.74 and G_SLICE=always-malloc; one
+ * more is allowed for GObject bookkeeping which differs between
+ * versions. A copy of each of the four strings would go over.
+ */
+#define MAX_ALLOCATIONS_PER_EXTENSION  28
+
+static void
+test_parse_list (void)
+{
+  g_autoptr(GVariant) list = deap_fixtures_new_extension_list (N_EXTENSIONS);
+  g_autoptr(GPtrArray) extensions = deap_shell_extension_parse_list (list);
+  DeapShellExtension *extension;
+
+  g_assert_cmpuint (extensions->len, ==, N_EXTENSIONS);
+
+  extension = g_ptr_array_index (extensions, 42);
+  g_assert_cmpstr (deap_shell_extension_get_uuid (extension), ==, "extension-42@deap.example.org");
+  g_assert_cmpstr (deap_shell_extension_get_name (extension), ==, "Extension 42");
+  g_assert_cmpstr (deap_shell_extension_get_url (extension), ==, "https://extensions.example.org/42");
+  g_assert_cmpint (deap_shell_extension_get_state (extension), ==, DEAP_SHELL_EXTENSION_STATE_ENABLED);
+
+  /* Borrowed from the reply, not copied */
+  g_assert_true (deap_shell_extension_get_name (extension) >= (const gchar *) g_variant_get_data (list));
+  g_assert_true (deap_shell_extension_get_name (extension) <
+                 (const gchar *) g_variant_get_data (list) + g_variant_get_size (list));
+}
+
+static void
+test_allocations (void)
+{
+  g_autoptr(GVariant) list = deap_fixtures_new_extension_list (N_EXTENSIONS);
+  GPtrArray *extensions;
+  guint64 allocations;
+
+  if (!deap_alloc_count_is_supported ()) {
+    g_test_skip ("Allocations are only counted with glibc");
+    return;
+  }
+
+  /* Interns the UUIDs and sets the type up */
+  g_ptr_array_unref (deap_shell_extension_parse_list (list));
+
+  deap_alloc_count_begin ();
+  extensions = deap_shell_extension_parse_list (list);
+  allocations = deap_alloc_count_end ();
+
+  g_ptr_array_unref (extensions);
+
+  g_test_message ("%.2f allocations per extension", (gdouble) allocations / N_EXTENSIONS);
+  g_assert_cmpuint (allocations, <=, (guint64) MAX_ALLOCATIONS_PER_EXTENSION * N_EXTENSIONS);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/shell-extension/parse-list", test_parse_list);
+  g_test_add_func ("/shell-extension/allocations", test_allocations);
+
+  return g_test_run ();
+}